@@ -0,0 +1,354 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_BODY_H
+#define __DBUSXX_BODY_H
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "message.h"
+
+namespace DBus {
+
+/*
+ *   BodyWriter serializes arguments straight into a buffer laid out in the
+ *   D-Bus wire format (native byte order), then hands the whole body over
+ *   to a Message at once with attach(); the writing interface is the same
+ *   as MessageIter's so all the operator << overloads work with both.
+ *
+ *   Contents are only validated by libdbus when attached. Unix fds can't be
+ *   carried this way, they have to go through a MessageIter.
+ */
+
+class DXXAPI BodyWriter
+{
+public:
+
+	BodyWriter();
+
+	BodyWriter(const BodyWriter &w);
+
+	BodyWriter &operator = (const BodyWriter &w);
+
+	bool append_byte(unsigned char byte);
+
+	bool append_bool(bool b);
+
+	bool append_int16(signed short i);
+
+	bool append_uint16(unsigned short u);
+
+	bool append_int32(signed int i);
+
+	bool append_uint32(unsigned int u);
+
+	bool append_int64(signed long long i);
+
+	bool append_uint64(unsigned long long i);
+
+	bool append_double(double d);
+
+	bool append_string(const char *chars);
+
+	bool append_path(const char *chars);
+
+	bool append_signature(const char *chars);
+
+	bool append_array(char type, const void *ptr, size_t length);
+
+	BodyWriter new_array(const char *sig);
+
+	BodyWriter new_variant(const char *sig);
+
+	BodyWriter new_struct();
+
+	BodyWriter new_dict_entry();
+
+	void close_container(BodyWriter &container);
+
+	/*	appends every value from the iterator onwards
+	*/
+	void copy_data(MessageIter &from);
+
+	/*	replaces the (empty) body of the message with the one written so far
+	*/
+	void attach(Message &msg) const;
+
+	void clear();
+
+	const std::string &signature() const
+	{
+		return _root->_sig;
+	}
+
+	const char *data() const
+	{
+		return _root->_body.data();
+	}
+
+	size_t size() const
+	{
+		return _root->_body.size();
+	}
+
+private:
+
+	DXXAPILOCAL BodyWriter(BodyWriter *root, char container, bool records);
+
+	DXXAPILOCAL void align(size_t n);
+
+	DXXAPILOCAL void put(const void *ptr, size_t len);
+
+	DXXAPILOCAL void basic(char type, const void *ptr, size_t len);
+
+	DXXAPILOCAL void chars(const char *chars, size_t len);
+
+private:
+
+	BodyWriter *_root;	// the top level writer, which owns the buffer
+	char _container;	// type of the container being written, 0 at top level
+	bool _records;		// whether the types written go in the body signature
+	size_t _len_at;		// where the length of an array goes
+	size_t _start;		// where the elements of an array start
+
+	std::string _body;
+	std::string _sig;
+};
+
+/*
+ *   A signature compiled once into a flat program: one op per signature
+ *   character with its wire alignment, its size when it's fixed, and the
+ *   index of the op following the complete type it starts
+ */
+
+class DXXAPI SignaturePlan
+{
+public:
+
+	struct Op
+	{
+		char type;
+		unsigned char align;
+		unsigned short next;
+		size_t size;	// 0 for values of variable size
+	};
+
+	SignaturePlan(const char *sig);
+
+	const std::string &signature() const
+	{
+		return _sig;
+	}
+
+	const Op &operator [] (size_t i) const
+	{
+		return _ops[i];
+	}
+
+	size_t length() const
+	{
+		return _ops.size();
+	}
+
+private:
+
+	DXXAPILOCAL size_t compile(size_t i);
+
+private:
+
+	std::string _sig;
+	std::vector<Op> _ops;
+};
+
+/*
+ *   BodyReader walks the raw body of a message in a single pass. The
+ *   message signature is checked against the plan once, up front (the
+ *   message may carry more arguments after those of the plan, as with
+ *   MessageIter they're just not read), after which values are read
+ *   without any per element type checks; the operator >> overloads in
+ *   types.h fill C++ objects from it.
+ *
+ *   libdbus doesn't let the body be read in place, so the reader starts
+ *   by taking a copy of the whole message: it only pays off for bodies
+ *   with many values, for small ones MessageIter is cheaper.
+ *
+ *   Strings and arrays handed out point into the reader's own copy of the
+ *   body and stay valid as long as the reader does. Unix fds can't be read
+ *   this way.
+ */
+
+class DXXAPI BodyReader
+{
+public:
+
+	BodyReader(const Message &msg, const SignaturePlan &plan);
+
+	/*	reads a body serialized on its own in native byte order, as kept
+		by Variant, without copying it; it has to outlive the reader
+	*/
+	BodyReader(const char *body, size_t len);
+
+	~BodyReader();
+
+	unsigned char get_byte()
+	{
+		return fixed<uint8_t>();
+	}
+
+	bool get_bool()
+	{
+		return fixed<uint32_t>() != 0;
+	}
+
+	signed short get_int16()
+	{
+		return fixed<int16_t>();
+	}
+
+	unsigned short get_uint16()
+	{
+		return fixed<uint16_t>();
+	}
+
+	signed int get_int32()
+	{
+		return fixed<int32_t>();
+	}
+
+	unsigned int get_uint32()
+	{
+		return fixed<uint32_t>();
+	}
+
+	signed long long get_int64()
+	{
+		return fixed<int64_t>();
+	}
+
+	unsigned long long get_uint64()
+	{
+		return fixed<uint64_t>();
+	}
+
+	double get_double()
+	{
+		return fixed<double>();
+	}
+
+	const char *get_string(size_t *len = NULL);
+
+	const char *get_path(size_t *len = NULL)
+	{
+		return get_string(len);
+	}
+
+	const char *get_signature();
+
+	/*	returns where the array ends, elements can be read until at_end()
+	*/
+	size_t begin_array(char type);
+
+	void begin_struct()
+	{
+		align(8);
+	}
+
+	bool at_end(size_t end) const
+	{
+		return _pos >= end;
+	}
+
+	size_t position() const
+	{
+		return _pos;
+	}
+
+	/*	all the elements of an array of fixed size type at once, still in
+		the message byte order (see swapped())
+	*/
+	const void *get_array(char type, size_t *count);
+
+	bool swapped() const
+	{
+		return _swap;
+	}
+
+	static void swap(void *ptr, size_t count, size_t size);
+
+	/*	re-serializes the next value, of the given signature, in native
+		byte order
+	*/
+	void copy_value(const char *sig, BodyWriter &to);
+
+private:
+
+	template <typename T>
+	T fixed()
+	{
+		align(sizeof(T));
+		need(sizeof(T));
+
+		T v;
+		memcpy(&v, _buf + _pos, sizeof(T));
+		_pos += sizeof(T);
+
+		if (_swap) swap(&v, 1, sizeof(T));
+		return v;
+	}
+
+	void align(size_t n)
+	{
+		_pos = (_pos + n - 1) & ~(n - 1);
+	}
+
+	void need(size_t n)
+	{
+		if (_pos + n > _end) overrun();
+	}
+
+	// reached from the inline readers, so exported with the class
+	void overrun();
+
+	DXXAPILOCAL void copy(const SignaturePlan &plan, size_t i, BodyWriter &to);
+
+	BodyReader(const BodyReader &);
+
+	BodyReader &operator = (const BodyReader &);
+
+private:
+
+	char *_buf;	// the whole marshalled message
+	size_t _pos;	// offsets are from the start of the message, for alignment
+	size_t _end;
+	bool _swap;
+	bool _owned;	// _buf was marshalled for this reader
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_BODY_H
@@ -26,6 +26,7 @@
 #define __DBUSXX_CONNECTION_H
 
 #include <list>
+#include <vector>
 
 #include "api.h"
 #include "types.h"
@@ -39,6 +40,8 @@ class Connection;
 
 typedef Slot<bool, const Message&> MessageSlot;
 
+typedef Slot<void, bool> CongestionSlot;
+
 typedef std::list<Connection>	ConnectionList;
 
 class ObjectAdaptor;
@@ -142,6 +145,40 @@ public:
 	 */
 	void remove_match( const char* rule );
 
+	/*!
+	 * \brief Adds a match rule without waiting for the bus to answer.
+	 *
+	 * Identical rules are counted instead of being added again: only the
+	 * first reference sends AddMatch, and only the release of the last one
+	 * (see remove_match_async()) sends RemoveMatch. Changes are queued
+	 * and sent together the next time the connection is dispatched, a
+	 * rule added and removed in between doesn't reach the bus at all.
+	 *
+	 * Failures are kept and reported by sync_matches().
+	 *
+	 * \param rule Textual form of match rule.
+	 */
+	void add_match_async( const char* rule );
+
+	/*!
+	 * \brief Releases a reference to a rule added with add_match_async().
+	 *
+	 * Unlike remove_match(), rules are compared textually here.
+	 *
+	 * \param rule Textual form of match rule.
+	 */
+	void remove_match_async( const char* rule );
+
+	/*!
+	 * \brief Waits until the bus has answered every match rule change
+	 *        made with add_match_async() and remove_match_async() so far.
+	 *
+	 * Only needed when signals mustn't be missed from a given point on.
+	 *
+	 * \throw Error The first change the bus refused since the last call.
+	 */
+	void sync_matches();
+
 	/*!
 	 * \brief Adds a message filter.
 	 *
@@ -354,6 +391,50 @@ public:
 	 */
 	bool send( const Message& msg, unsigned int* serial = NULL );
 
+	/*!
+	 * \brief Adds several messages to the outgoing message queue, in order.
+	 *
+	 * The same as calling send() for each of them, except that they are
+	 * queued in one go: nothing sent from another thread meanwhile gets in
+	 * between, and the whole burst goes out back to back. libdbus still
+	 * writes each message with a call of its own.
+	 *
+	 * \param msgs The Messages to write.
+	 * \return true On success, false if some of them couldn't be queued.
+	 */
+	bool send_batch( const std::vector<Message>& msgs );
+
+	/*!
+	 * \brief Holds back the messages sent on a connection for as long as it lives.
+	 *
+	 * While a Cork is around, send() and send_batch() only keep the messages
+	 * aside; they are queued for real, in the order they were sent, when the
+	 * last Cork on the connection goes away. Anything that needs the messages
+	 * to be out (a call expecting a reply, flush(), or send() asked for the
+	 * serial) sends those kept so far first.
+	 *
+	 * Corks nest and may be taken from any thread; the messages sent by other
+	 * threads meanwhile are held back as well.
+	 */
+	class DXXAPI Cork
+	{
+	public:
+
+		Cork( Connection& conn );
+
+		~Cork();
+
+	private:
+
+		DXXAPILOCAL Cork( const Cork& );
+
+		DXXAPILOCAL Cork& operator = ( const Cork& );
+
+	private:
+
+		Connection& _conn;
+	};
+
 	/*!
 	 * \brief Sends a message and blocks a certain time period while waiting for a reply.
 	 *
@@ -459,6 +540,53 @@ public:
 	
 	int get_timeout();
 
+	/*!
+	 * \brief Gets the approximate size in bytes of the messages waiting to be written.
+	 */
+	long outgoing_size();
+
+	/*!
+	 * \brief Sets when the connection is to be seen as congested.
+	 *
+	 * The connection becomes congested once its outgoing queue has grown past
+	 * high bytes, which is checked whenever something is sent, and stops being
+	 * so when the queue is back under low bytes, which is checked whenever the
+	 * dispatcher writes to it. A high watermark of 0 (the default) turns this off.
+	 *
+	 * Producers can pause while is_congested() says so, or have the handler
+	 * set with set_congestion_handler() tell them.
+	 *
+	 * \param high The queue size in bytes the connection gets congested above.
+	 * \param low The queue size in bytes it stops being congested under.
+	 */
+	void set_watermarks(long high, long low);
+
+	bool is_congested();
+
+	/*!
+	 * \brief Sets a handler called with true when the connection gets congested,
+	 *        and false when it stops being so.
+	 *
+	 * The former is called from the thread sending the message going past the
+	 * high watermark, the latter from the dispatching thread.
+	 */
+	void set_congestion_handler(const CongestionSlot &handler);
+
+	/*!
+	 * \brief Sets the most bytes of incoming messages libdbus reads ahead
+	 *        before it stops reading from the connection.
+	 */
+	void set_max_received_size(long size);
+
+	long get_max_received_size();
+
+	/*!
+	 * \brief The same for the number of unix file descriptors.
+	 */
+	void set_max_received_unix_fds(long n);
+
+	long get_max_received_unix_fds();
+
 private:
 
 	DXXAPILOCAL void init();
@@ -469,6 +597,9 @@ private:
 	int _timeout;
 
 friend class ObjectAdaptor; // needed in order to register object paths for a connection
+friend class ThreadPoolDispatcher; // sends replies queued by other threads
+friend class SubtreeAdaptor; // registers a fallback for a whole subtree
+friend class ObjectProxy; // subscribes to the signals of its interfaces
 };
 
 } /* namespace DBus */
@@ -28,11 +28,14 @@
 #include "types.h"
 #include "interface.h"
 #include "object.h"
+#include "subtree.h"
 #include "property.h"
 #include "connection.h"
 #include "server.h"
 #include "error.h"
 #include "message.h"
+#include "body.h"
+#include "validate.h"
 #include "debug.h"
 #include "pendingcall.h"
 #include "server.h"
@@ -40,6 +43,7 @@
 #include "dispatcher.h"
 #include "eventloop.h"
 #include "eventloop-integration.h"
+#include "threadpool.h"
 #include "introspection.h"
 
 #endif//__DBUSXX_DBUS_H
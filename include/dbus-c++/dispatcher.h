@@ -31,6 +31,9 @@
 
 namespace DBus {
 
+class ObjectAdaptor;
+class Tag;
+
 class DXXAPI Timeout
 {
 public:
@@ -145,12 +148,15 @@ private:
 private:
 
 	Internal *_int;
+	Dispatcher *_disp;	// the one it was added to, if any
+
+friend class Dispatcher;
 };
 
 class DXXAPI Dispatcher
 {
 public:
-	Dispatcher() : _dispatching(false) {}
+	Dispatcher();
 
 	virtual ~Dispatcher()
 	{}
@@ -160,6 +166,22 @@ public:
 	void dispatch_pending();
 	bool has_something_to_dispatch();
 
+	/*	how much a single dispatch_pending() may do, in messages and in
+		microseconds, before going back to the loop; zero means no limit.
+		Connections are served one message at a time in turn, those left
+		with something to dispatch are resumed at the next iteration
+	*/
+	void dispatch_budget(unsigned int messages, unsigned int usecs = 0);
+
+	/*	connections over their outgoing high watermark, looked at again
+		whenever one of our watches gets written to, see
+		Connection::set_watermarks(); they're put on and taken off the
+		list as their congested flag changes, under the same lock
+	*/
+	void update_congested(Connection::Private *, long size);
+	void forget_congested(Connection::Private *);
+	void check_congested();
+
 	virtual void enter() = 0;
 
 	virtual void leave() = 0;
@@ -172,13 +194,80 @@ public:
 
 	virtual void rem_watch(Watch *) = 0;
 
+	/*	brings the dispatching thread back from waiting for events, to look
+		at connections queued from elsewhere; may be called from any thread
+	*/
+	virtual void wake_up()
+	{}
+
+	/*	method calls for local objects are handled on the dispatching thread
+		unless the dispatcher takes them here, to run them elsewhere through
+		ObjectAdaptor::invoke() (see ThreadPoolDispatcher)
+	*/
+	virtual bool post_call(ObjectAdaptor *, const CallMessage &)
+	{
+		return false;
+	}
+
+	/*	the same for the reply to a call a local object answers later, see
+		ObjectAdaptor::return_now()
+	*/
+	virtual bool post_return(ObjectAdaptor *, const Tag *, const Message &)
+	{
+		return false;
+	}
+
+	/*	a local object is going away: whatever the dispatcher took for it
+		and hasn't run yet has to be dropped, and what's running elsewhere
+		finished, before this returns
+	*/
+	virtual void forget_object(ObjectAdaptor *)
+	{}
+
+	/*	replies and signals from local objects go out through here, so that
+		handlers running elsewhere can have them sent by the dispatching
+		thread
+	*/
+	virtual void post_message(Connection &conn, const Message &msg)
+	{
+		conn.send(msg);
+	}
+
 	struct Private;
 
+	/*	the connections with something to dispatch are chained through
+		one of these, which they carry themselves
+	*/
+	struct PendingLink
+	{
+		PendingLink *next;
+		int queued;	// already in the queue, or being dispatched
+
+		PendingLink() : next(NULL), queued(0)
+		{}
+	};
+
+private:
+
+	DXXAPILOCAL void push_pending(PendingLink *);
+	DXXAPILOCAL PendingLink *pop_pending();
+
 private:
 
-	DefaultMutex _mutex_p;
-	Connection::PrivatePList _pending_queue;
+	/*	a multiple producers, single consumer queue: the connections are
+		queued from wherever libdbus tells about them without a lock nor
+		an allocation, only the dispatching thread takes them off
+	*/
+	PendingLink *_pending_head;
+	PendingLink *_pending_tail;
+	PendingLink _pending_stub;
+	int _pending_count;
 	bool _dispatching;
+
+	DefaultMutex _mutex_c;
+	Connection::PrivatePList _congested;
+	unsigned int _budget_messages;
+	unsigned int _budget_usecs;
 };
 
 extern DXXAPI Dispatcher *default_dispatcher;
@@ -87,7 +87,9 @@ friend class BusDispatcher;
 class DXXAPI BusDispatcher : public Dispatcher
 {
 public:
-	BusDispatcher() {}
+	BusDispatcher();
+
+	~BusDispatcher();
 
 	void attach();
 
@@ -103,8 +105,16 @@ public:
 
 	void rem_watch( Watch* );
 
+	void wake_up();
+
+private:
+
+	static void wake_up_handler( void*, void*, unsigned int );
+
 private:
 
+	Ecore_Pipe *_pipe;	// made with the first watch, once ecore is up
+	int _woken;
 };
 
 } /* namespace Ecore */
@@ -28,6 +28,7 @@
 #include <cstring>
 #include <errno.h>
 #include <unistd.h>
+#include <set>
 #include "api.h"
 #include "dispatcher.h"
 #include "util.h"
@@ -59,33 +60,22 @@ class DXXAPI BusWatch : public Watch, public DefaultWatch
 friend class BusDispatcher;
 };
 
+/*	something to run on the dispatching thread, see BusDispatcher::post()
+*/
+typedef Slot<void, BusDispatcher &> TaskSlot;
+
 class DXXAPI BusDispatcher : public Dispatcher, public DefaultMainLoop
 {
 public:
 
-	int _pipe[2];
-
-	BusDispatcher() : _running(false)
-	{
-		//pipe to create a new fd used to unlock a dispatcher at any
-    // moment (used by leave function)
-		int ret = pipe(_pipe);
-		if (ret == -1) {
-                  char buffer[128]; // buffer copied in Error constructor
-                  throw Error("PipeError:errno", strerror_r(errno,
-                                                            buffer,
-                                                            sizeof(buffer)));
-                }
-		_fdunlock[0] = _pipe[0];
-		_fdunlock[1] = _pipe[1];
-		
-	}
-
-	~BusDispatcher()
-	{}
+	BusDispatcher(backend_type backend = BACKEND_POLL);
+
+	~BusDispatcher();
 
 	virtual void enter();
 
+	/*	may be called from any thread
+	*/
 	virtual void leave();
 
 	virtual void do_iteration();
@@ -102,9 +92,56 @@ public:
 
 	void timeout_expired(DefaultTimeout &);
 
+	/*	have task run by the dispatching thread at its next iteration;
+		may be called from any thread, without blocking, and posts made
+		before the loop wakes up take a single wakeup between them
+	*/
+	void post(const TaskSlot &task);
+
+	/*	the same, but not before delay milliseconds from now
+	*/
+	void post_delayed(const TaskSlot &task, int delay);
+
+	/*	may be called from any thread
+	*/
+	virtual void wake_up();
+
+	struct Task;
+
+private:
+
+	DXXAPILOCAL void tasks_ready(DefaultWatch &);
+
+	DXXAPILOCAL void run_tasks();
+
+	DXXAPILOCAL void task_expired(DefaultTimeout &);
+
 private:
 
 	bool _running;
+
+	/*	the tasks posted since the last wakeup, newest first; they are
+		pushed with a compare and swap and taken all at once
+	*/
+	Task *_tasks;
+	Task *_taken;		// taken by the last wakeup, oldest first
+	int _woken;		// a wakeup is already on its way
+	int _wakefd[2];		// the same eventfd twice, or a pipe
+	DefaultWatch *_wake_watch;
+	std::set<DefaultTimeout *> _delayed;
+};
+
+/*
+ * A BusDispatcher waiting on io_uring; it quietly falls back to epoll or
+ * poll() when the kernel doesn't support it, backend() tells which
+ */
+
+class DXXAPI IoUringDispatcher : public BusDispatcher
+{
+public:
+
+	IoUringDispatcher() : BusDispatcher(BACKEND_IO_URING)
+	{}
 };
 
 } /* namespace DBus */
@@ -27,6 +27,7 @@
 
 #include <pthread.h>
 #include <list>
+#include <vector>
 
 #include "api.h"
 #include "util.h"
@@ -51,10 +52,10 @@ public:
 	virtual ~DefaultTimeout();
 
 	bool enabled(){ return _enabled; }
-	void enabled(bool e){ _enabled = e; }
+	void enabled(bool e);
 
 	int interval(){ return _interval; }
-	void interval(int i){ _interval = i; }
+	void interval(int i);
 
 	bool repeat(){ return _repeat; }
 	void repeat(bool r){ _repeat = r; }
@@ -71,12 +72,15 @@ private:
 	int _interval;
 	bool _repeat;
 
-	double _expiration;
+	double _expiration;	// monotonic time, in milliseconds
+	size_t _slot;		// position in the loop's timer heap while armed
 
 	void *_data;
 	
 	DefaultMainLoop *_disp;
 
+	std::list<DefaultTimeout *>::iterator _link;
+
 friend class DefaultMainLoop;
 };
 
@@ -91,12 +95,12 @@ public:
 	virtual ~DefaultWatch();
 
 	bool enabled(){ return _enabled; }
-	void enabled(bool e){ _enabled = e; }
+	void enabled(bool e);
 
 	int descriptor(){ return _fd; }
 
 	int flags(){ return _flags; }
-	void flags(int f){ _flags = f; }
+	void flags(int f);
 
 	int state(){ return _state; }
 
@@ -113,6 +117,9 @@ private:
 	int _flags;
 	int _state;
 
+	int _efd;	// descriptor registered with epoll, -1 if none
+	void *_poll;	// poll request queued on the io_uring, if any
+
 	void *_data;
 
 	DefaultMainLoop *_disp;
@@ -146,21 +153,84 @@ class DXXAPI DefaultMainLoop
 {
 public:
 
-	DefaultMainLoop();
+	/*	how the loop waits for its watches: poll() builds the whole set
+		again at every iteration, epoll keeps it in the kernel and is only
+		told about changes, which is what you want with many connections;
+		io_uring also batches those changes with the wait itself
+	*/
+	enum backend_type {
+		BACKEND_POLL,
+		BACKEND_EPOLL,
+		BACKEND_IO_URING
+	};
+
+	DefaultMainLoop(backend_type backend = BACKEND_POLL);
 
 	virtual ~DefaultMainLoop();
 
 	virtual void dispatch();
 
-	int _fdunlock[2];
+	/*	the same, but waiting no longer than max_wait milliseconds
+	*/
+	void dispatch(int max_wait);
+
+	/*	the backend actually in use, io_uring falls back to epoll and
+		epoll to poll() where they are not available
+	*/
+	backend_type backend() const;
+
+private:
+
+	DXXAPILOCAL int next_timeout();
+
+	DXXAPILOCAL void poll_watches(int wait);
+
+	DXXAPILOCAL void epoll_watches(int wait);
+
+	DXXAPILOCAL void epoll_update(DefaultWatch *);
+
+	DXXAPILOCAL void epoll_forget(DefaultWatch *);
+
+	DXXAPILOCAL bool uring_setup();
+
+	DXXAPILOCAL void uring_teardown();
+
+	DXXAPILOCAL void uring_watches(int wait);
+
+	DXXAPILOCAL void uring_update(DefaultWatch *);
+
+	DXXAPILOCAL void uring_forget(DefaultWatch *);
+
+	DXXAPILOCAL void run_timeouts();
+
+	DXXAPILOCAL void arm(DefaultTimeout *, double now);
+
+	DXXAPILOCAL void disarm(DefaultTimeout *);
+
+	DXXAPILOCAL void sift_up(size_t);
+
+	DXXAPILOCAL void sift_down(size_t);
+
+	DXXAPILOCAL void update_watch(DefaultWatch *);
+
+	DXXAPILOCAL void forget_watch(DefaultWatch *);
+
 private:
 
 	DefaultMutex _mutex_t;
 	DefaultTimeouts _timeouts;
+	std::vector<DefaultTimeout *> _heap;	// armed timeouts, earliest first
+	std::vector<DefaultTimeout *> _expired;	// timeouts being dispatched
 
 	DefaultMutex _mutex_w;
 	DefaultWatches _watches;
 
+	int _epfd;
+
+	struct Ring;
+	Ring *_ring;
+	std::vector<DefaultWatch *> _ready;	// watches with events being dispatched
+
 friend class DefaultTimeout;
 friend class DefaultWatch;
 };
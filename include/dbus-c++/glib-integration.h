@@ -107,6 +107,8 @@ public:
 
 	void rem_watch(Watch *);
 
+	void wake_up();
+
 	void set_priority(int priority);
 
 private:
@@ -65,6 +65,11 @@ protected:
 
 	InterfaceAdaptor *find_interface(const std::string &name);
 
+	/*	the same for a name straight out of a message, without making a
+		string of it; NULL finds nothing
+	*/
+	InterfaceAdaptor *find_interface(const char *name);
+
 	virtual ~AdaptorBase()
 	{}
 
@@ -92,6 +97,8 @@ protected:
 
 	InterfaceProxy *find_interface(const std::string &name);
 
+	InterfaceProxy *find_interface(const char *name);
+
 	virtual ~ProxyBase()
 	{}
 
@@ -157,6 +164,11 @@ public:
 
 	void emit_signal(const SignalMessage &);
 
+	/*	a new signal from a template, on the object's path unless the
+		template has one of its own
+	*/
+	SignalMessage create_signal(const SignalTemplate &tpl);
+
 	Variant *get_property(const std::string &name);
 
 	void set_property(const std::string &name, Variant &value);
@@ -170,6 +182,12 @@ public:
 
 protected:
 
+	/*	calls the handler of a member; generated adaptors override it with
+		a lookup compiled in for their own methods, and come back here for
+		those registered by hand
+	*/
+	virtual Message _dispatch_method(const char *member, const CallMessage &);
+
 	MethodTable	_methods;
 	PropertyTable	_properties;
 };
@@ -209,6 +227,10 @@ protected:
 	 */
 	void remove_pending_call(PendingCall *pending);
 
+	/*	the same as InterfaceAdaptor::_dispatch_method(), for signals
+	*/
+	virtual void _dispatch_signal(const char *member, const SignalMessage &);
+
 	SignalTable	_signals;
 };
 
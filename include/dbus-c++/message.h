@@ -158,7 +158,11 @@ private:
 
 	struct Private;
 
-	Private *_pvt;
+	/*	storage for the underlying DBusMessageIter, kept inline so that
+		creating or copying an iterator never touches the heap; sixteen
+		pointers are enough for every libdbus ABI (checked in message_p.h)
+	*/
+	void *_iter[16];
 
 	Message *_msg;
 
@@ -227,6 +231,11 @@ friend class MessageIter;
 friend class Error;
 friend class Connection;
 friend class TagMessage;
+friend class Variant;
+friend class BodyWriter;
+friend class BodyReader;
+friend class SignalTemplate;
+friend class ThreadPoolDispatcher;
 };
 
 /*
@@ -273,6 +282,58 @@ public:
 	bool path(const char *p);
 
 	bool operator == (const SignalMessage &) const;
+
+private:
+
+	DXXAPILOCAL SignalMessage(Private *p);
+
+friend class SignalTemplate;
+};
+
+/*
+ *   The header of a signal, built and validated the first time a signal is
+ *   made from it; each emission then starts from a copy of it and only has
+ *   to append the arguments. The names aren't copied, they have to live as
+ *   long as the template (string literals do)
+ */
+
+class DXXAPI SignalTemplate
+{
+public:
+
+	SignalTemplate(const char *interface, const char *member);
+
+	SignalTemplate(const char *path, const char *interface, const char *member);
+
+	SignalTemplate(const SignalTemplate &);
+
+	~SignalTemplate();
+
+	/*	may be called from several threads at once; the signal goes out
+		on default_path if the template has no path of its own, the one
+		given when the header gets built is kept from then on
+	*/
+	SignalMessage create(const char *default_path = NULL) const;
+
+	bool has_path() const
+	{
+		return !_path.empty();
+	}
+
+	/*	not while signals are being made from the template
+	*/
+	void path(const char *p);
+
+private:
+
+	DXXAPILOCAL SignalTemplate &operator = (const SignalTemplate &);
+
+private:
+
+	const char *_interface;
+	const char *_member;
+	std::string _path;
+	mutable Message *_header;
 };
 
 /*
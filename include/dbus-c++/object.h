@@ -33,6 +33,7 @@
 #include "connection.h"
 #include "message.h"
 #include "types.h"
+#include "eventloop.h"
 
 namespace DBus {
 
@@ -97,6 +98,24 @@ public:
 	{}
 };
 
+/*
+ * An execution domain several objects can share: on a dispatcher running
+ * handlers on many threads, those of all the objects constructed with the
+ * same Strand run one at a time (see ThreadPoolDispatcher)
+ */
+
+class DXXAPI Strand
+{
+public:
+
+	Strand()
+	{}
+
+private:
+
+	DXXAPILOCAL Strand(const Strand &);
+};
+
 /*
 */
 
@@ -109,12 +128,21 @@ class DXXAPI ObjectAdaptor : public Object, public virtual AdaptorBase
 {
 public:
 
+	/*	these look at the objects of every connection, the overloads
+		taking one only at its own
+	*/
 	static ObjectAdaptor *from_path(const Path &path);
 
+	static ObjectAdaptor *from_path(Connection &conn, const Path &path);
+
 	static ObjectAdaptorPList from_path_prefix(const std::string &prefix);
 
+	static ObjectAdaptorPList from_path_prefix(Connection &conn, const std::string &prefix);
+
 	static ObjectPathList child_nodes_from_prefix(const std::string &prefix);
 
+	static ObjectPathList child_nodes_from_prefix(Connection &conn, const std::string &prefix);
+
 	struct Private;
 
 	enum registration_time {
@@ -127,10 +155,22 @@ public:
 		AVOID_EXCEPTIONS
 	};
 
+	/*	where handlers run, when the dispatcher runs them on many threads
+	*/
+	enum execution_domain {
+		DISPATCHER_DOMAIN,	// ordered by the dispatcher's own rules
+		STRAND_DOMAIN,		// one at a time, independently of other objects
+		FREE_DOMAIN		// concurrently, the object does its own locking
+	};
+
 	ObjectAdaptor(Connection &conn, const Path &path);
 	ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime);
 	ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime,
 		      exceptions_flag eflag);
+	ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime,
+		      exceptions_flag eflag, execution_domain domain);
+	ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime,
+		      exceptions_flag eflag, Strand &strand);
 
 	~ObjectAdaptor();
 
@@ -177,12 +217,28 @@ private:
 
 	bool handle_message(const Message &);
 
+	/*	runs the handler for a call and sends back its reply
+	*/
+	void invoke(const CallMessage &);
+
+	/*	sends the reply of a continuation and forgets about it
+	*/
+	void finish(const Tag *tag, const Message &reply);
+
+	void post_message(const Message &);
+
 	typedef std::map<const Tag *, Continuation *> ContinuationMap;
 	ContinuationMap _continuations;
+	DefaultMutex _mutex_c;	// handlers may run on several threads
 
 	exceptions_flag _eflag;
 
+	execution_domain _domain;
+	const void *_strand;	// what the handlers are serialized on, if anything
+
 friend struct Private;
+friend class ThreadPoolDispatcher;
+friend class SubtreeAdaptor;
 };
 
 const ObjectAdaptor *ObjectAdaptor::object() const
@@ -212,8 +268,9 @@ typedef std::list<ObjectProxy *> ObjectProxyPList;
  * be invoked and signals can be received.
  *
  * ObjectProxy objects should not be deleted while in a callback
- * handling either a signal or a pending call reply. Doing so may
- * result in a deadlock.
+ * handling one of their own pending call replies, the call is then
+ * deleted under it. Signal match rules are added and removed without
+ * waiting for the bus (see Connection::add_match_async()).
  */
 class DXXAPI ObjectProxy : public Object, public virtual ProxyBase
 {
@@ -244,10 +301,10 @@ protected:
 private:
 	void cancel_pending_calls();
 
-	MessageSlot _filtered;
-
 	typedef std::vector<PendingCall*> PendingCallList;
 	PendingCallList _pending_calls;
+
+friend struct SignalRouter;
 };
 
 const ObjectProxy *ObjectProxy::object() const
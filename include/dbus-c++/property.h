@@ -51,9 +51,11 @@ public:
 
 	PropertyAdaptor &operator = (const T &t)
 	{
-		_data->value.clear();
-		MessageIter wi = _data->value.writer();
+		// write through a temporary so the stored value stays compact
+		Variant value;
+		MessageIter wi = value.writer();
 		wi << t;
+		_data->value = value;
 		return *this;
 	}
 
@@ -38,7 +38,7 @@ RefPtrI<T>::RefPtrI(T *ptr)
 template <class T>
 RefPtrI<T>::~RefPtrI()
 {
-	if (__cnt.one()) delete __ptr;
+	if (__cnt.release()) delete __ptr;
 }
 
 } /* namespace DBus */
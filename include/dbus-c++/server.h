@@ -55,6 +55,15 @@ public:
 
 	void disconnect();
 
+	/*!
+	 * \brief Incoming limits set on every connection accepted from now on,
+	 *        before on_new_connection() sees it; see Connection::set_max_received_size().
+	 *        A negative value keeps the libdbus default.
+	 */
+	void set_max_received_size(long size);
+
+	void set_max_received_unix_fds(long n);
+
 	struct Private;
 
 protected:
@@ -0,0 +1,115 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_SUBTREE_H
+#define __DBUSXX_SUBTREE_H
+
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "connection.h"
+#include "object.h"
+#include "types.h"
+
+namespace DBus {
+
+/*
+ * Every object below a path, resolved when a call comes for it instead of
+ * being registered one by one: the whole subtree is a single libdbus
+ * fallback, and the objects only exist while they're used.
+ *
+ * resolve() builds the object for a path (with REGISTER_LATER, the subtree
+ * does the registering); it's deleted once the call is handled, or kept in
+ * a cache of the given size, the least recently used going first. Objects
+ * with calls still to answer (see ObjectAdaptor::return_later()) are kept
+ * until they're done, past the size if need be, and go with the next call
+ * to the subtree once they are; those emitting signals on their own have
+ * to stay alive meanwhile, so need the cache.
+ *
+ * enumerate() tells Introspect which children a node of the subtree has,
+ * the nodes resolve() has no object for get an introspection of their own
+ * listing them.
+ *
+ * Calls are handled on the dispatching thread, whatever the dispatcher.
+ */
+
+class DXXAPI SubtreeAdaptor
+{
+public:
+
+	SubtreeAdaptor(Connection &conn, const Path &prefix, size_t cache_size = 0);
+
+	virtual ~SubtreeAdaptor();
+
+	/*	the object at the path made of the prefix and suffix ("" being the
+		prefix itself, "a/b" the object at prefix/a/b), or NULL if there's
+		none; the subtree takes ownership of it
+	*/
+	virtual ObjectAdaptor *resolve(const std::string &suffix) = 0;
+
+	/*	the names of the children of a node of the subtree
+	*/
+	virtual void enumerate(const std::string &suffix, std::vector<std::string> &children);
+
+	/*	drops the cached object for a suffix, or every one of them; the
+		cache belongs to the dispatching thread, these are only to be
+		called from there, and not by the object being dropped
+	*/
+	void forget(const std::string &suffix);
+
+	void forget_all();
+
+	const Path &prefix() const
+	{
+		return _prefix;
+	}
+
+	Connection &conn()
+	{
+		return _conn;
+	}
+
+	struct Private;
+
+private:
+
+	DXXAPILOCAL SubtreeAdaptor(const SubtreeAdaptor &);
+
+	DXXAPILOCAL bool handle_message(const Message &);
+
+	DXXAPILOCAL Message introspect(const CallMessage &);
+
+	DXXAPILOCAL static bool busy(ObjectAdaptor *);
+
+private:
+
+	Connection _conn;
+	Path _prefix;
+	Private *_pvt;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_SUBTREE_H
@@ -0,0 +1,86 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_THREADPOOL_H
+#define __DBUSXX_THREADPOOL_H
+
+#include "api.h"
+#include "eventloop-integration.h"
+
+namespace DBus {
+
+/*
+ * A BusDispatcher handing method calls for local objects over to a pool
+ * of worker threads, so that a slow handler doesn't hold up every other
+ * object on the connection. Replies and signals sent by the handlers are
+ * passed back to the dispatching thread, which sends them.
+ *
+ * Calls with the same ordering key are run one at a time, in the order
+ * they came in; calls with different keys run in parallel. An object can
+ * override that with its execution domain: its calls, and the replies of
+ * its continuations, then go to its own strand, a Strand it shares with
+ * other objects, or straight to any free worker.
+ *
+ * It enables libdbus thread support, so create it before any connection.
+ */
+
+class DXXAPI ThreadPoolDispatcher : public BusDispatcher
+{
+public:
+
+	enum ordering_type {
+		ORDER_PER_SENDER,	// calls from the same peer
+		ORDER_PER_OBJECT,	// calls to the same object
+		ORDER_NONE
+	};
+
+	ThreadPoolDispatcher(int threads, ordering_type ordering = ORDER_PER_SENDER,
+		backend_type backend = BACKEND_POLL);
+
+	~ThreadPoolDispatcher();
+
+	virtual bool post_call(ObjectAdaptor *, const CallMessage &);
+
+	virtual bool post_return(ObjectAdaptor *, const Tag *, const Message &);
+
+	virtual void forget_object(ObjectAdaptor *);
+
+	virtual void post_message(Connection &conn, const Message &msg);
+
+	struct Private;
+
+private:
+
+	DXXAPILOCAL void replies_ready(BusDispatcher &);
+
+	DXXAPILOCAL static void *worker(void *);
+
+private:
+
+	Private *_pvt;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_THREADPOOL_H
@@ -26,13 +26,16 @@
 #define __DBUSXX_TYPES_H
 
 #include <stdint.h>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <map>
+#include <utility>
 
 #include "api.h"
 #include "util.h"
 #include "message.h"
+#include "body.h"
 #include "error.h"
 
 namespace DBus {
@@ -76,8 +79,96 @@ private:
 	int _fd;
 };
 
+/*
+ *   Borrowed views: demarshalling into these points straight into the
+ *   buffer read from instead of copying. Read with a MessageIter they are
+ *   valid for as long as the Message is alive; read with a BodyReader,
+ *   only for as long as the reader is, whatever becomes of the Message
+ */
+
+class DXXAPI StringRef
+{
+public:
+
+	StringRef() : _data(""), _size(0) {}
+	StringRef(const char *c) : _data(c), _size(strlen(c)) {}
+	StringRef(const char *c, size_t len) : _data(c), _size(len) {}
+	StringRef(const std::string &s) : _data(s.c_str()), _size(s.size()) {}
+
+	const char *data() const { return _data; }
+	const char *c_str() const { return _data; }
+	size_t size() const { return _size; }
+	size_t length() const { return _size; }
+	bool empty() const { return _size == 0; }
+
+	const char *begin() const { return _data; }
+	const char *end() const { return _data + _size; }
+	char operator [] (size_t i) const { return _data[i]; }
+
+	std::string str() const { return std::string(_data, _size); }
+	operator std::string() const { return str(); }
+
+	bool operator == (const StringRef &s) const
+	{
+		return _size == s._size && memcmp(_data, s._data, _size) == 0;
+	}
+	bool operator != (const StringRef &s) const { return !(*this == s); }
+
+private:
+
+	const char *_data;
+	size_t _size;
+};
+
+struct DXXAPI PathRef : public StringRef
+{
+	PathRef() {}
+	PathRef(const char *c) : StringRef(c) {}
+	PathRef(const char *c, size_t len) : StringRef(c, len) {}
+	PathRef(const Path &p) : StringRef(p) {}
+
+	operator Path() const { return Path(str()); }
+};
+
+/*	only defined for the fixed size types which travel in their native
+	representation: bytes, integers and doubles
+*/
+template <typename T>
+class ArrayRef
+{
+public:
+
+	ArrayRef() : _data(0), _size(0) {}
+	ArrayRef(const T *data, size_t size) : _data(data), _size(size) {}
+	ArrayRef(const std::vector<T> &v) : _data(v.data()), _size(v.size()) {}
+
+	const T *data() const { return _data; }
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+
+	const T *begin() const { return _data; }
+	const T *end() const { return _data + _size; }
+	const T &operator [] (size_t i) const { return _data[i]; }
+
+	std::vector<T> vec() const { return std::vector<T>(begin(), end()); }
+
+private:
+
+	const T *_data;
+	size_t _size;
+};
+
 struct DXXAPI Invalid {};
 
+template <typename T, bool readable>
+struct _variant_body;
+
+/*
+ *   Variants keep basic values inline and anything else as a serialized
+ *   body plus its signature; a real Message is only built when the value
+ *   is accessed through reader() or writer()
+ */
+
 class DXXAPI Variant
 {
 public:
@@ -86,28 +177,97 @@ public:
 
 	Variant(MessageIter &it);
 
+	Variant(const Variant &v);
+
+	Variant(Variant &&v) noexcept;
+
+	~Variant();
+
 	Variant &operator = (const Variant &v);
 
+	Variant &operator = (Variant &&v) noexcept;
+
 	const Signature signature() const;
 
 	void clear();
 
-	MessageIter reader() const
-	{
-		return _msg.reader();
-	}
+	MessageIter reader() const;
 
-	MessageIter writer()
-	{
-		return _msg.writer();
-	}
+	MessageIter writer();
 
 	template <typename T>
 	operator T() const;
 
 private:
 
-	Message _msg;
+	/*	fast paths for operator T(), return false when the value
+		has to be read back through a message
+	*/
+	template <typename T>
+	bool get_inline(T &) const { return false; }
+
+	bool get_inline(uint8_t &) const;
+	bool get_inline(bool &) const;
+	bool get_inline(int16_t &) const;
+	bool get_inline(uint16_t &) const;
+	bool get_inline(int32_t &) const;
+	bool get_inline(uint32_t &) const;
+	bool get_inline(int64_t &) const;
+	bool get_inline(uint64_t &) const;
+	bool get_inline(double &) const;
+	bool get_inline(std::string &) const;
+	bool get_inline(Path &) const;
+	bool get_inline(Signature &) const;
+
+	DXXAPILOCAL void store(Message &msg);
+
+	DXXAPILOCAL bool store_basic(MessageIter &it);
+
+	DXXAPILOCAL void sync() const;
+
+	/*	where a value serialized as sig starts in _data, NULL when it's
+		stored some other way; reached from operator T()
+	*/
+	const char *body(const char *sig, size_t *len) const;
+
+	Message materialize() const;
+
+	template <typename W>
+	DXXAPILOCAL void append_to(W &it) const;
+
+private:
+
+	union Basic
+	{
+		uint8_t  y;
+		bool     b;
+		int16_t  n;
+		uint16_t q;
+		int32_t  i;
+		uint32_t u;
+		int64_t  x;
+		uint64_t t;
+		double   d;
+	};
+
+	char _type;		// type code of a basic value, DBUS_TYPE_ARRAY for compound ones
+	Basic _basic;
+	std::string _data;	// string value, or signature + '\0' + body of a compound value
+
+	enum { SYNCED, WRITTEN, SYNCING };
+
+	/*	reading a const variant may still build _msg or pick up what was
+		written through it, each done once per variant with atomics on the
+		two fields below (see reader() and sync())
+	*/
+	mutable Message *_msg;	// built on demand by reader() and writer()
+	mutable int _sync;	// WRITTEN when _msg is newer than the fields above
+
+template <typename T, bool readable> friend struct _variant_body;
+friend DXXAPI MessageIter &operator << (MessageIter &, const Variant &);
+friend DXXAPI BodyWriter &operator << (BodyWriter &, const Variant &);
+friend DXXAPI MessageIter &operator >> (MessageIter &, Variant &);
+friend DXXAPI BodyReader &operator >> (BodyReader &, Variant &);
 };
 
 template <
@@ -131,6 +291,44 @@ inline bool dict_has_key(const std::map<K,V>& map, const K &key)
 	return map.find(key) != map.end();
 }
 
+/*
+ *   Signatures known at compile time: StaticSig<'a','s'>::value is the
+ *   null-terminated array "as", emitted once as constant data
+ */
+
+template <char... C>
+struct StaticSig
+{
+	static const char value[sizeof...(C) + 1];
+};
+
+template <char... C>
+const char StaticSig<C...>::value[sizeof...(C) + 1] = { C..., '\0' };
+
+/*	marks a type whose signature is only known at run time
+	(e.g. a user specialization of type<T> which provides sig() only)
+*/
+struct NoStaticSig {};
+
+template <typename... S>
+struct StaticSigCat;
+
+template <>
+struct StaticSigCat<> { typedef StaticSig<> chars; };
+
+template <typename S>
+struct StaticSigCat<S> { typedef S chars; };
+
+template <char... A, char... B, typename... R>
+struct StaticSigCat<StaticSig<A...>, StaticSig<B...>, R...>
+: StaticSigCat<StaticSig<A..., B...>, R...> {};
+
+template <typename S, typename... R>
+struct StaticSigCat<NoStaticSig, S, R...> { typedef NoStaticSig chars; };
+
+template <char... A, typename... R>
+struct StaticSigCat<StaticSig<A...>, NoStaticSig, R...> { typedef NoStaticSig chars; };
+
 template <typename T>
 struct type
 {
@@ -141,28 +339,95 @@ struct type
 	}
 };
 
-template <> struct type<Variant>        { static std::string sig(){ return "v"; } };
-template <> struct type<uint8_t>        { static std::string sig(){ return "y"; } };
-template <> struct type<bool>           { static std::string sig(){ return "b"; } };
-template <> struct type<int16_t>        { static std::string sig(){ return "n"; } };
-template <> struct type<uint16_t>       { static std::string sig(){ return "q"; } };
-template <> struct type<int32_t>        { static std::string sig(){ return "i"; } };
-template <> struct type<uint32_t>       { static std::string sig(){ return "u"; } };
-template <> struct type<int64_t>        { static std::string sig(){ return "x"; } };
-template <> struct type<uint64_t>       { static std::string sig(){ return "t"; } };
-template <> struct type<double>         { static std::string sig(){ return "d"; } };
-template <> struct type<std::string>    { static std::string sig(){ return "s"; } };
-template <> struct type<Path>           { static std::string sig(){ return "o"; } };
-template <> struct type<Signature>      { static std::string sig(){ return "g"; } };
-template <> struct type<Invalid>        { static std::string sig(){ return "";  } };
+template <typename T, typename Probe>
+struct _static_sig_enable { typedef T type; };
+
+/*	static_sig<T>::chars is type<T>::chars when available, NoStaticSig otherwise
+*/
+template <typename T, typename Enable = void>
+struct static_sig { typedef NoStaticSig chars; };
+
+template <typename T>
+struct static_sig<T, typename _static_sig_enable<void, typename type<T>::chars>::type>
+{ typedef typename type<T>::chars chars; };
+
+/*	sig_of<T>::c_str() is the signature of T without any run time work,
+	falling back to a single (cached) call to type<T>::sig() for types
+	which don't have a compile time signature
+*/
+template <typename T, typename C = typename static_sig<T>::chars>
+struct sig_of
+{
+	static const char *c_str() { return C::value; }
+};
+
+template <typename T>
+struct sig_of<T, NoStaticSig>
+{
+	static const char *c_str()
+	{
+		static const std::string sig = type<T>::sig();
+		return sig.c_str();
+	}
+};
+
+#define DBUSXX_BASIC_TYPE_SIG(T, c) \
+	template <> struct type<T> \
+	{ \
+		typedef StaticSig<c> chars; \
+		static std::string sig(){ return chars::value; } \
+	};
+
+DBUSXX_BASIC_TYPE_SIG(Variant,        'v')
+DBUSXX_BASIC_TYPE_SIG(uint8_t,        'y')
+DBUSXX_BASIC_TYPE_SIG(bool,           'b')
+DBUSXX_BASIC_TYPE_SIG(int16_t,        'n')
+DBUSXX_BASIC_TYPE_SIG(uint16_t,       'q')
+DBUSXX_BASIC_TYPE_SIG(int32_t,        'i')
+DBUSXX_BASIC_TYPE_SIG(uint32_t,       'u')
+DBUSXX_BASIC_TYPE_SIG(int64_t,        'x')
+DBUSXX_BASIC_TYPE_SIG(uint64_t,       't')
+DBUSXX_BASIC_TYPE_SIG(double,         'd')
+DBUSXX_BASIC_TYPE_SIG(std::string,    's')
+DBUSXX_BASIC_TYPE_SIG(Path,           'o')
+DBUSXX_BASIC_TYPE_SIG(Signature,      'g')
+DBUSXX_BASIC_TYPE_SIG(FileDescriptor, 'h')
+DBUSXX_BASIC_TYPE_SIG(StringRef,      's')
+DBUSXX_BASIC_TYPE_SIG(PathRef,        'o')
+
+#undef DBUSXX_BASIC_TYPE_SIG
+
+template <> struct type<Invalid>
+{
+	typedef StaticSig<> chars;
+	static std::string sig(){ return "";  }
+};
 
 template <typename E> 
 struct type< std::vector<E> >
-{ static std::string sig(){ return "a" + type<E>::sig(); } };
+{
+	typedef typename StaticSigCat<
+		StaticSig<'a'>, typename static_sig<E>::chars
+	>::chars chars;
+
+	static std::string sig(){ return std::string("a") + sig_of<E>::c_str(); }
+};
+
+template <typename E>
+struct type< ArrayRef<E> > : type< std::vector<E> > {};
 
 template <typename K, typename V>
 struct type< std::map<K,V> >
-{ static std::string sig(){ return "a{" + type<K>::sig() + type<V>::sig() + "}"; } };
+{
+	typedef typename StaticSigCat<
+		StaticSig<'a','{'>, typename static_sig<K>::chars, typename static_sig<V>::chars, StaticSig<'}'>
+	>::chars chars;
+
+	static std::string sig()
+	{
+		return std::string("a{") + sig_of<K>::c_str() + sig_of<V>::c_str() + "}";
+	}
+};
 
 template <
 	typename T1,
@@ -176,111 +441,172 @@ template <
 >
 struct type< Struct<T1,T2,T3,T4,T5,T6,T7,T8> >
 { 
+	typedef typename StaticSigCat<
+		StaticSig<'('>,
+		typename static_sig<T1>::chars,
+		typename static_sig<T2>::chars,
+		typename static_sig<T3>::chars,
+		typename static_sig<T4>::chars,
+		typename static_sig<T5>::chars,
+		typename static_sig<T6>::chars,
+		typename static_sig<T7>::chars,
+		typename static_sig<T8>::chars,
+		StaticSig<')'>
+	>::chars chars;
+
 	static std::string sig()
 	{ 
-		return "("
-			+ type<T1>::sig()
-			+ type<T2>::sig()
-			+ type<T3>::sig()
-			+ type<T4>::sig()
-			+ type<T5>::sig()
-			+ type<T6>::sig()
-			+ type<T7>::sig()
-			+ type<T8>::sig()
+		return std::string("(")
+			+ sig_of<T1>::c_str()
+			+ sig_of<T2>::c_str()
+			+ sig_of<T3>::c_str()
+			+ sig_of<T4>::c_str()
+			+ sig_of<T5>::c_str()
+			+ sig_of<T6>::c_str()
+			+ sig_of<T7>::c_str()
+			+ sig_of<T8>::c_str()
 			+ ")";
 	}
 };
 
+/*
+ *   The writers below work on MessageIter as well as BodyWriter,
+ *   which share the same interface
+ */
+
+template <typename W>
+struct _writer {};
+
+template <>
+struct _writer<MessageIter> { typedef MessageIter type; };
+
+template <>
+struct _writer<BodyWriter> { typedef BodyWriter type; };
+
 extern DXXAPI DBus::MessageIter &operator << (DBus::MessageIter &iter, const DBus::Variant &val);
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const DBus::Invalid &)
+extern DXXAPI DBus::BodyWriter &operator << (DBus::BodyWriter &iter, const DBus::Variant &val);
+
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::Invalid &)
 {
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const uint8_t &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const uint8_t &val)
 {
 	iter.append_byte(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const bool &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const bool &val)
 {
 	iter.append_bool(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const int16_t& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const int16_t& val)
 {
 	iter.append_int16(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const uint16_t& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const uint16_t& val)
 {
 	iter.append_uint16(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const int32_t& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const int32_t& val)
 {
 	iter.append_int32(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const uint32_t& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const uint32_t& val)
 {
 	iter.append_uint32(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const int64_t& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const int64_t& val)
 {
 	iter.append_int64(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const uint64_t& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const uint64_t& val)
 {
 	iter.append_uint64(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const double &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const double &val)
 {
 	iter.append_double(val);
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const std::string &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const std::string &val)
 {
-	iter.append_string(val.c_str());
+	if (!iter.append_string(val.c_str()))
+		throw DBus::ErrorInvalidArgs("invalid string");
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const DBus::Path &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::Path &val)
 {
-	iter.append_path(val.c_str());
+	if (!iter.append_path(val.c_str()))
+		throw DBus::ErrorInvalidArgs("invalid object path");
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const DBus::Signature &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::Signature &val)
 {
-	iter.append_signature(val.c_str());
+	if (!iter.append_signature(val.c_str()))
+		throw DBus::ErrorInvalidArgs("invalid signature");
 	return iter;
 }
 
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const DBus::FileDescriptor &val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::FileDescriptor &val)
 {
 	iter.append_fd(val.get());
 	return iter;
 }
 
-template<typename E>
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const std::vector<E>& val)
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::StringRef &val)
+{
+	if (!iter.append_string(val.c_str()))
+		throw DBus::ErrorInvalidArgs("invalid string");
+	return iter;
+}
+
+template <typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::PathRef &val)
+{
+	if (!iter.append_path(val.c_str()))
+		throw DBus::ErrorInvalidArgs("invalid object path");
+	return iter;
+}
+
+template<typename W, typename E>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const std::vector<E>& val)
 {
-	const std::string sig = DBus::type<E>::sig();
-	DBus::MessageIter ait = iter.new_array(sig.c_str());
+	W ait = iter.new_array(DBus::sig_of<E>::c_str());
 
 	typename std::vector<E>::const_iterator vit;
 	for (vit = val.begin(); vit != val.end(); ++vit)
@@ -292,25 +618,64 @@ inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const std::vecto
 	return iter;
 }
 
-template<>
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const std::vector<uint8_t>& val)
+/*
+ *   Arrays of fixed size types are copied in bulk rather than element by element
+ */
+
+#define DBUSXX_FIXED_ARRAY_WRITER(T, c) \
+	template<typename W> \
+	inline typename DBus::_writer<W>::type &operator << (W &iter, const std::vector<T>& val) \
+	{ \
+		static const char sig[] = { c, '\0' }; \
+		W ait = iter.new_array(sig); \
+		ait.append_array(c, val.data(), val.size()); \
+		iter.close_container(ait); \
+		return iter; \
+	} \
+	\
+	template<typename W> \
+	inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::ArrayRef<T>& val) \
+	{ \
+		static const char sig[] = { c, '\0' }; \
+		W ait = iter.new_array(sig); \
+		ait.append_array(c, val.data(), val.size()); \
+		iter.close_container(ait); \
+		return iter; \
+	}
+
+DBUSXX_FIXED_ARRAY_WRITER(uint8_t,  'y')
+DBUSXX_FIXED_ARRAY_WRITER(int16_t,  'n')
+DBUSXX_FIXED_ARRAY_WRITER(uint16_t, 'q')
+DBUSXX_FIXED_ARRAY_WRITER(int32_t,  'i')
+DBUSXX_FIXED_ARRAY_WRITER(uint32_t, 'u')
+DBUSXX_FIXED_ARRAY_WRITER(int64_t,  'x')
+DBUSXX_FIXED_ARRAY_WRITER(uint64_t, 't')
+DBUSXX_FIXED_ARRAY_WRITER(double,   'd')
+
+#undef DBUSXX_FIXED_ARRAY_WRITER
+
+template<typename W>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const std::vector<bool>& val)
 {
-	DBus::MessageIter ait = iter.new_array("y");
-	ait.append_array('y', &val.front(), val.size());
+	// booleans travel as 32 bit dbus_bool_t's, widen them first
+	std::vector<uint32_t> wide(val.begin(), val.end());
+
+	W ait = iter.new_array("b");
+	ait.append_array('b', wide.data(), wide.size());
 	iter.close_container(ait);
 	return iter;
 }
 
-template<typename K, typename V>
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const std::map<K,V>& val)
+template<typename W, typename K, typename V>
+inline typename DBus::_writer<W>::type &operator << (W &iter, const std::map<K,V>& val)
 {
-	const std::string sig = "{" + DBus::type<K>::sig() + DBus::type<V>::sig() + "}";
-	DBus::MessageIter ait = iter.new_array(sig.c_str());
+	// the element signature is the map signature without the leading 'a'
+	W ait = iter.new_array(DBus::sig_of< std::map<K,V> >::c_str() + 1);
 
 	typename std::map<K,V>::const_iterator mit;
 	for (mit = val.begin(); mit != val.end(); ++mit)
 	{
-		DBus::MessageIter eit = ait.new_dict_entry();
+		W eit = ait.new_dict_entry();
 
 		eit << mit->first << mit->second;
 
@@ -322,6 +687,7 @@ inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const std::map<K
 }
 
 template <
+	typename W,
 	typename T1,
 	typename T2,
 	typename T3,
@@ -331,13 +697,13 @@ template <
 	typename T7,
 	typename T8
 >
-inline DBus::MessageIter &operator << (DBus::MessageIter &iter, const DBus::Struct<T1,T2,T3,T4,T5,T6,T7,T8>& val)
+inline typename DBus::_writer<W>::type &operator << (W &iter, const DBus::Struct<T1,T2,T3,T4,T5,T6,T7,T8>& val)
 {
 /*	const std::string sig = 
 		DBus::type<T1>::sig() + DBus::type<T2>::sig() + DBus::type<T3>::sig() + DBus::type<T4>::sig() +
 		DBus::type<T5>::sig() + DBus::type<T6>::sig() + DBus::type<T7>::sig() + DBus::type<T8>::sig();
 */
-	DBus::MessageIter sit = iter.new_struct(/*sig.c_str()*/);
+	W sit = iter.new_struct(/*sig.c_str()*/);
 
 	sit << val._1 << val._2 << val._3 << val._4 << val._5 << val._6 << val._7 << val._8;
 
@@ -432,6 +798,18 @@ inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, DBus::FileDescri
 	return ++iter;
 }
 
+inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, DBus::StringRef &val)
+{
+	val = iter.get_string();
+	return ++iter;
+}
+
+inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, DBus::PathRef &val)
+{
+	val = iter.get_path();
+	return ++iter;
+}
+
 extern DXXAPI DBus::MessageIter &operator >> (DBus::MessageIter &iter, DBus::Variant &val);
 
 template<typename E>
@@ -442,32 +820,87 @@ inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, std::vector<E>&
 
 	DBus::MessageIter ait = iter.recurse();
 
+	/*	each element is moved in once read, so a failed read leaves no half
+		read element behind
+	*/
 	while (!ait.at_end())
 	{
 		E elem;
 
 		ait >> elem;
 
-		val.push_back(elem);
+		val.push_back(std::move(elem));
 	}
 	return ++iter;
 }
 
+#define DBUSXX_FIXED_ARRAY_READER(T, c, what) \
+	template<> \
+	inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, std::vector<T>& val) \
+	{ \
+		if (!iter.is_array()) \
+			throw DBus::ErrorInvalidArgs("array expected"); \
+	\
+		if (iter.array_type() != c) \
+			throw DBus::ErrorInvalidArgs(what "-array expected"); \
+	\
+		DBus::MessageIter ait = iter.recurse(); \
+	\
+		T *array; \
+		size_t length = ait.get_array(&array); \
+	\
+		val.insert(val.end(), array, array+length); \
+	\
+		return ++iter; \
+	} \
+	\
+	inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, DBus::ArrayRef<T>& val) \
+	{ \
+		if (!iter.is_array()) \
+			throw DBus::ErrorInvalidArgs("array expected"); \
+	\
+		if (iter.array_type() != c) \
+			throw DBus::ErrorInvalidArgs(what "-array expected"); \
+	\
+		DBus::MessageIter ait = iter.recurse(); \
+	\
+		T *array; \
+		size_t length = ait.get_array(&array); \
+	\
+		val = DBus::ArrayRef<T>(array, length); \
+	\
+		return ++iter; \
+	}
+
+DBUSXX_FIXED_ARRAY_READER(uint8_t,  'y', "byte")
+DBUSXX_FIXED_ARRAY_READER(int16_t,  'n', "int16")
+DBUSXX_FIXED_ARRAY_READER(uint16_t, 'q', "uint16")
+DBUSXX_FIXED_ARRAY_READER(int32_t,  'i', "int32")
+DBUSXX_FIXED_ARRAY_READER(uint32_t, 'u', "uint32")
+DBUSXX_FIXED_ARRAY_READER(int64_t,  'x', "int64")
+DBUSXX_FIXED_ARRAY_READER(uint64_t, 't', "uint64")
+DBUSXX_FIXED_ARRAY_READER(double,   'd', "double")
+
+#undef DBUSXX_FIXED_ARRAY_READER
+
 template<>
-inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, std::vector<uint8_t>& val)
+inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, std::vector<bool>& val)
 {
 	if (!iter.is_array())
 		throw DBus::ErrorInvalidArgs("array expected");
 
-	if (iter.array_type() != 'y')
-		throw DBus::ErrorInvalidArgs("byte-array expected");
+	if (iter.array_type() != 'b')
+		throw DBus::ErrorInvalidArgs("boolean-array expected");
 
 	DBus::MessageIter ait = iter.recurse();
 
-	uint8_t *array;
+	uint32_t *array;
 	size_t length = ait.get_array(&array);
 
-	val.insert(val.end(), array, array+length);
+	val.reserve(val.size() + length);
+
+	for (size_t i = 0; i < length; ++i)
+		val.push_back(array[i] != 0);
 
 	return ++iter;
 }
@@ -482,13 +915,18 @@ inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, std::map<K,V>& v
 
 	while (!mit.at_end())
 	{
-		K key; V value;
+		K key;
 
 		DBus::MessageIter eit = mit.recurse();
 
-		eit >> key >> value;
+		eit >> key;
+
+		V value;
+
+		eit >> value;
 
-		val[key] = value;
+		// moved in once read, a repeated key replaces the earlier entry
+		val[std::move(key)] = std::move(value);
 
 		++mit;
 	}
@@ -515,12 +953,319 @@ inline DBus::MessageIter &operator >> (DBus::MessageIter &iter, DBus::Struct<T1,
 	return ++iter;
 }
 
+/*
+ *   Readers for BodyReader; the message signature has already been checked
+ *   against the plan, so none of these look at type codes
+ */
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::Invalid &)
+{
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, uint8_t &val)
+{
+	val = reader.get_byte();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, bool &val)
+{
+	val = reader.get_bool();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, int16_t& val)
+{
+	val = reader.get_int16();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, uint16_t& val)
+{
+	val = reader.get_uint16();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, int32_t& val)
+{
+	val = reader.get_int32();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, uint32_t& val)
+{
+	val = reader.get_uint32();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, int64_t& val)
+{
+	val = reader.get_int64();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, uint64_t& val)
+{
+	val = reader.get_uint64();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, double &val)
+{
+	val = reader.get_double();
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, std::string &val)
+{
+	size_t len;
+	const char *chars = reader.get_string(&len);
+
+	val.assign(chars, len);
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::Path &val)
+{
+	size_t len;
+	const char *chars = reader.get_path(&len);
+
+	val.assign(chars, len);
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::Signature &val)
+{
+	val.assign(reader.get_signature());
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::StringRef &val)
+{
+	size_t len;
+	const char *chars = reader.get_string(&len);
+
+	val = DBus::StringRef(chars, len);
+	return reader;
+}
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::PathRef &val)
+{
+	size_t len;
+	const char *chars = reader.get_path(&len);
+
+	val = DBus::PathRef(chars, len);
+	return reader;
+}
+
+extern DXXAPI DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::Variant &val);
+
+template<typename E>
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, std::vector<E>& val)
+{
+	static const DBus::SignaturePlan element(DBus::sig_of<E>::c_str());
+
+	size_t end = reader.begin_array(element[0].type);
+
+	// the length of an array of fixed size elements gives their count
+	if (element[0].size)
+	{
+		size_t stride = (element[0].size + element[0].align - 1) & ~(element[0].align - 1);
+
+		val.reserve(val.size() + (end - reader.position()) / stride + 1);
+	}
+
+	while (!reader.at_end(end))
+	{
+		E elem;
+
+		reader >> elem;
+
+		val.push_back(std::move(elem));
+	}
+	return reader;
+}
+
+#define DBUSXX_FIXED_ARRAY_BODY_READER(T, c) \
+	inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, std::vector<T>& val) \
+	{ \
+		size_t length; \
+		const T *array = static_cast<const T *>(reader.get_array(c, &length)); \
+		size_t at = val.size(); \
+	\
+		val.insert(val.end(), array, array+length); \
+	\
+		if (reader.swapped() && length) \
+			DBus::BodyReader::swap(&val[at], length, sizeof(T)); \
+	\
+		return reader; \
+	} \
+	\
+	inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::ArrayRef<T>& val) \
+	{ \
+		if (reader.swapped()) \
+			throw DBus::ErrorInvalidArgs("can't borrow an array in foreign byte order"); \
+	\
+		size_t length; \
+		const T *array = static_cast<const T *>(reader.get_array(c, &length)); \
+	\
+		val = DBus::ArrayRef<T>(array, length); \
+		return reader; \
+	}
+
+DBUSXX_FIXED_ARRAY_BODY_READER(uint8_t,  'y')
+DBUSXX_FIXED_ARRAY_BODY_READER(int16_t,  'n')
+DBUSXX_FIXED_ARRAY_BODY_READER(uint16_t, 'q')
+DBUSXX_FIXED_ARRAY_BODY_READER(int32_t,  'i')
+DBUSXX_FIXED_ARRAY_BODY_READER(uint32_t, 'u')
+DBUSXX_FIXED_ARRAY_BODY_READER(int64_t,  'x')
+DBUSXX_FIXED_ARRAY_BODY_READER(uint64_t, 't')
+DBUSXX_FIXED_ARRAY_BODY_READER(double,   'd')
+
+#undef DBUSXX_FIXED_ARRAY_BODY_READER
+
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, std::vector<bool>& val)
+{
+	size_t length;
+	const uint32_t *array = static_cast<const uint32_t *>(reader.get_array('b', &length));
+
+	val.reserve(val.size() + length);
+
+	// a swapped non zero value is still non zero
+	for (size_t i = 0; i < length; ++i)
+		val.push_back(array[i] != 0);
+
+	return reader;
+}
+
+template<typename K, typename V>
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, std::map<K,V>& val)
+{
+	size_t end = reader.begin_array('{');
+
+	while (!reader.at_end(end))
+	{
+		K key;
+
+		reader.begin_struct();
+		reader >> key;
+
+		V value;
+
+		reader >> value;
+
+		val[std::move(key)] = std::move(value);
+	}
+	return reader;
+}
+
+template <
+	typename T1,
+	typename T2,
+	typename T3,
+	typename T4,
+	typename T5,
+	typename T6,
+	typename T7,
+	typename T8
+>
+inline DBus::BodyReader &operator >> (DBus::BodyReader &reader, DBus::Struct<T1,T2,T3,T4,T5,T6,T7,T8>& val)
+{
+	reader.begin_struct();
+
+	reader >> val._1 >> val._2 >> val._3 >> val._4 >> val._5 >> val._6 >> val._7 >> val._8;
+
+	return reader;
+}
+
+/*	the types read by the BodyReader overloads above, compound values of
+	these are read straight from the variant's serialized body; any other
+	type may only have a MessageIter reader, so it's read through a message
+*/
+template <typename T>
+struct _body_readable { static const bool value = false; };
+
+#define DBUSXX_BODY_READABLE(T) \
+	template <> struct _body_readable<T> { static const bool value = true; };
+
+DBUSXX_BODY_READABLE(Invalid)
+DBUSXX_BODY_READABLE(Variant)
+DBUSXX_BODY_READABLE(uint8_t)
+DBUSXX_BODY_READABLE(bool)
+DBUSXX_BODY_READABLE(int16_t)
+DBUSXX_BODY_READABLE(uint16_t)
+DBUSXX_BODY_READABLE(int32_t)
+DBUSXX_BODY_READABLE(uint32_t)
+DBUSXX_BODY_READABLE(int64_t)
+DBUSXX_BODY_READABLE(uint64_t)
+DBUSXX_BODY_READABLE(double)
+DBUSXX_BODY_READABLE(std::string)
+DBUSXX_BODY_READABLE(Path)
+DBUSXX_BODY_READABLE(Signature)
+
+#undef DBUSXX_BODY_READABLE
+
+template <typename E>
+struct _body_readable< std::vector<E> > { static const bool value = _body_readable<E>::value; };
+
+template <typename K, typename V>
+struct _body_readable< std::map<K,V> >
+{
+	static const bool value = _body_readable<K>::value && _body_readable<V>::value;
+};
+
+template <
+	typename T1,
+	typename T2,
+	typename T3,
+	typename T4,
+	typename T5,
+	typename T6,
+	typename T7,
+	typename T8
+>
+struct _body_readable< Struct<T1,T2,T3,T4,T5,T6,T7,T8> >
+{
+	static const bool value =
+		_body_readable<T1>::value && _body_readable<T2>::value &&
+		_body_readable<T3>::value && _body_readable<T4>::value &&
+		_body_readable<T5>::value && _body_readable<T6>::value &&
+		_body_readable<T7>::value && _body_readable<T8>::value;
+};
+
+template <typename T, bool readable = _body_readable<T>::value>
+struct _variant_body
+{
+	static bool get(const Variant &, T &) { return false; }
+};
+
+template <typename T>
+struct _variant_body<T, true>
+{
+	static bool get(const Variant &v, T &val)
+	{
+		size_t len;
+		const char *data = v.body(sig_of<T>::c_str(), &len);
+
+		if (!data) return false;
+
+		BodyReader ri(data, len);
+		ri >> val;
+		return true;
+	}
+};
+
 template <typename T>
 inline DBus::Variant::operator T() const
 {
 	T cast;
-	DBus::MessageIter ri = _msg.reader();
-	ri >> cast;
+	if (!get_inline(cast) && !_variant_body<T>::get(*this, cast))
+	{
+		DBus::Message msg = materialize();
+		DBus::MessageIter ri = msg.reader();
+		ri >> cast;
+	}
 	return cast;
 }
 
@@ -31,7 +31,8 @@
 namespace DBus {
 
 /*
- *   Very simple reference counting
+ *   Very simple reference counting; the count itself is updated atomically
+ *   so that copies can live on different threads
  */
 
 class DXXAPI RefCnt
@@ -52,46 +53,59 @@ public:
 
 	virtual ~RefCnt()
 	{
-		unref();
+		release();
 	}
 
 	RefCnt &operator = (const RefCnt &ref)
 	{
 		ref.ref();
-		unref();
+		release();
 		__ref = ref.__ref;
 		return *this;
 	}
 
+	/*	drops the reference this copy holds, leaving it empty; true when
+		it was the last one, which only one of the copies can see
+	*/
+	bool release()
+	{
+		if (!__ref) return false;
+
+		bool last = unref();
+		__ref = 0;
+		return last;
+	}
+
 	bool noref() const
 	{
-		return (*__ref) == 0;
+		return !__ref || __atomic_load_n(__ref, __ATOMIC_ACQUIRE) == 0;
 	}
 
 	bool one() const
 	{
-		return (*__ref) == 1;
+		return __ref && __atomic_load_n(__ref, __ATOMIC_ACQUIRE) == 1;
 	}
 
 private:
 
 	DXXAPILOCAL void ref() const
 	{
-		++ (*__ref);
+		__atomic_add_fetch(__ref, 1, __ATOMIC_RELAXED);
 	}
-	DXXAPILOCAL void unref() const
+	DXXAPILOCAL bool unref() const
 	{
-		-- (*__ref);
+		int left = __atomic_sub_fetch(__ref, 1, __ATOMIC_ACQ_REL);
 
-		if ((*__ref) < 0)
+		if (left < 0)
 		{
 			debug_log("%p: refcount dropped below zero!", __ref);
 		}
 
-		if (noref())
+		if (left == 0)
 		{
 			delete __ref;
 		}
+		return left == 0;
 	}
 
 private:
@@ -116,10 +130,14 @@ public:
 	{
 		if (this != &ref)
 		{
-			if (__cnt.one()) delete __ptr;
+			// ref may go with the object we let go of
+			RefCnt cnt(ref.__cnt);
+			T *ptr = ref.__ptr;
+
+			if (__cnt.release()) delete __ptr;
 
-			__ptr = ref.__ptr;
-			__cnt = ref.__cnt;
+			__ptr = ptr;
+			__cnt = cnt;
 		}
 		return *this;
 	}
@@ -160,17 +178,21 @@ public:
 
 	~RefPtr()
 	{
-		if (__cnt.one()) delete __ptr;
+		if (__cnt.release()) delete __ptr;
 	}
 
 	RefPtr &operator = (const RefPtr &ref)
 	{
 		if (this != &ref)
 		{
-			if (__cnt.one()) delete __ptr;
+			// ref may go with the object we let go of
+			RefCnt cnt(ref.__cnt);
+			T *ptr = ref.__ptr;
+
+			if (__cnt.release()) delete __ptr;
 
-			__ptr = ref.__ptr;
-			__cnt = ref.__cnt;
+			__ptr = ptr;
+			__cnt = cnt;
 		}
 		return *this;
 	}
@@ -0,0 +1,53 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_VALIDATE_H
+#define __DBUSXX_VALIDATE_H
+
+#include <stddef.h>
+
+#include "api.h"
+
+namespace DBus {
+
+/*
+ *   Checks for the values D-Bus requires to be well formed; on x86 they
+ *   pick SSE2 or AVX2 code at run time and fall back to plain C++ elsewhere
+ */
+
+/*	well formed UTF-8 without any embedded NUL, as strings must be
+*/
+extern DXXAPI bool validate_utf8(const char *chars, size_t len);
+
+/*	"/" or slash separated, non empty elements of [A-Za-z0-9_]
+*/
+extern DXXAPI bool validate_path(const char *chars, size_t len);
+
+/*	a sequence of complete types, within the nesting and length limits
+*/
+extern DXXAPI bool validate_signature(const char *chars, size_t len);
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_VALIDATE_H
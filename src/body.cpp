@@ -0,0 +1,759 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/body.h>
+#include <dbus-c++/error.h>
+#include <dbus-c++/validate.h>
+#include <dbus/dbus.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "message_p.h"
+#include "internalerror.h"
+
+using namespace DBus;
+
+static char byte_order()
+{
+	const dbus_uint32_t one = 1;
+
+	return *reinterpret_cast<const char *>(&one) ? DBUS_LITTLE_ENDIAN : DBUS_BIG_ENDIAN;
+}
+
+/*	wire alignment of a value starting with the given type code
+*/
+static size_t alignment(char type)
+{
+	switch (type)
+	{
+		case DBUS_TYPE_BYTE:
+		case DBUS_TYPE_SIGNATURE:
+		case DBUS_TYPE_VARIANT:
+			return 1;
+		case DBUS_TYPE_INT16:
+		case DBUS_TYPE_UINT16:
+			return 2;
+		case DBUS_TYPE_BOOLEAN:
+		case DBUS_TYPE_INT32:
+		case DBUS_TYPE_UINT32:
+		case DBUS_TYPE_STRING:
+		case DBUS_TYPE_OBJECT_PATH:
+		case DBUS_TYPE_ARRAY:
+		case DBUS_TYPE_UNIX_FD:
+			return 4;
+		default:	// 64 bit types, structs and dict entries
+			return 8;
+	}
+}
+
+static size_t fixed_size(char type)
+{
+	switch (type)
+	{
+		case DBUS_TYPE_BYTE:
+			return 1;
+		case DBUS_TYPE_INT16:
+		case DBUS_TYPE_UINT16:
+			return 2;
+		case DBUS_TYPE_BOOLEAN:
+		case DBUS_TYPE_INT32:
+		case DBUS_TYPE_UINT32:
+			return 4;
+		case DBUS_TYPE_INT64:
+		case DBUS_TYPE_UINT64:
+		case DBUS_TYPE_DOUBLE:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+BodyWriter::BodyWriter()
+: _root(this), _container(0), _records(true), _len_at(0), _start(0)
+{
+}
+
+BodyWriter::BodyWriter(BodyWriter *root, char container, bool records)
+: _root(root), _container(container), _records(records), _len_at(0), _start(0)
+{
+}
+
+BodyWriter::BodyWriter(const BodyWriter &w)
+: _root(w._root == &w ? this : w._root), _container(w._container), _records(w._records),
+  _len_at(w._len_at), _start(w._start), _body(w._body), _sig(w._sig)
+{
+}
+
+BodyWriter &BodyWriter::operator = (const BodyWriter &w)
+{
+	if (&w != this)
+	{
+		_root = w._root == &w ? this : w._root;
+		_container = w._container;
+		_records = w._records;
+		_len_at = w._len_at;
+		_start = w._start;
+		_body = w._body;
+		_sig = w._sig;
+	}
+	return *this;
+}
+
+void BodyWriter::align(size_t n)
+{
+	std::string &body = _root->_body;
+
+	body.resize((body.size() + n - 1) & ~(n - 1), '\0');
+}
+
+void BodyWriter::put(const void *ptr, size_t len)
+{
+	_root->_body.append(static_cast<const char *>(ptr), len);
+}
+
+void BodyWriter::basic(char type, const void *ptr, size_t len)
+{
+	if (_records) _root->_sig += type;
+
+	align(len);
+	put(ptr, len);
+}
+
+/*	strings and object paths share the same encoding
+*/
+void BodyWriter::chars(const char *chars, size_t len)
+{
+	dbus_uint32_t l = len;
+
+	align(4);
+	put(&l, sizeof(l));
+	put(chars, len + 1);
+}
+
+bool BodyWriter::append_byte(unsigned char byte)
+{
+	basic(DBUS_TYPE_BYTE, &byte, sizeof(byte));
+	return true;
+}
+
+bool BodyWriter::append_bool(bool b)
+{
+	dbus_uint32_t db = b;
+
+	basic(DBUS_TYPE_BOOLEAN, &db, sizeof(db));
+	return true;
+}
+
+bool BodyWriter::append_int16(signed short i)
+{
+	dbus_int16_t v = i;
+
+	basic(DBUS_TYPE_INT16, &v, sizeof(v));
+	return true;
+}
+
+bool BodyWriter::append_uint16(unsigned short u)
+{
+	dbus_uint16_t v = u;
+
+	basic(DBUS_TYPE_UINT16, &v, sizeof(v));
+	return true;
+}
+
+bool BodyWriter::append_int32(signed int i)
+{
+	dbus_int32_t v = i;
+
+	basic(DBUS_TYPE_INT32, &v, sizeof(v));
+	return true;
+}
+
+bool BodyWriter::append_uint32(unsigned int u)
+{
+	dbus_uint32_t v = u;
+
+	basic(DBUS_TYPE_UINT32, &v, sizeof(v));
+	return true;
+}
+
+bool BodyWriter::append_int64(signed long long i)
+{
+	dbus_int64_t v = i;
+
+	basic(DBUS_TYPE_INT64, &v, sizeof(v));
+	return true;
+}
+
+bool BodyWriter::append_uint64(unsigned long long u)
+{
+	dbus_uint64_t v = u;
+
+	basic(DBUS_TYPE_UINT64, &v, sizeof(v));
+	return true;
+}
+
+bool BodyWriter::append_double(double d)
+{
+	basic(DBUS_TYPE_DOUBLE, &d, sizeof(d));
+	return true;
+}
+
+/*	values which aren't well formed are refused, as libdbus would
+*/
+bool BodyWriter::append_string(const char *chars)
+{
+	size_t len = strlen(chars);
+
+	if (!validate_utf8(chars, len))
+		return false;
+
+	if (_records) _root->_sig += DBUS_TYPE_STRING;
+
+	this->chars(chars, len);
+	return true;
+}
+
+bool BodyWriter::append_path(const char *chars)
+{
+	size_t len = strlen(chars);
+
+	if (!validate_path(chars, len))
+		return false;
+
+	if (_records) _root->_sig += DBUS_TYPE_OBJECT_PATH;
+
+	this->chars(chars, len);
+	return true;
+}
+
+bool BodyWriter::append_signature(const char *chars)
+{
+	size_t len = strlen(chars);
+
+	if (!validate_signature(chars, len))
+		return false;
+
+	if (_records) _root->_sig += DBUS_TYPE_SIGNATURE;
+
+	unsigned char l = len;
+
+	put(&l, sizeof(l));
+	put(chars, len + 1);
+	return true;
+}
+
+/*	bulk copy of fixed size elements, only meaningful inside an array
+*/
+bool BodyWriter::append_array(char type, const void *ptr, size_t length)
+{
+	size_t size = fixed_size(type);
+
+	if (!size) return false;
+
+	align(size);
+	put(ptr, size * length);
+	return true;
+}
+
+BodyWriter BodyWriter::new_array(const char *sig)
+{
+	if (_records)
+	{
+		_root->_sig += DBUS_TYPE_ARRAY;
+		_root->_sig += sig;
+	}
+
+	BodyWriter arr(_root, DBUS_TYPE_ARRAY, false);
+
+	align(4);
+	arr._len_at = size();
+	put("\0\0\0\0", 4);
+
+	// the padding before the first element doesn't count in the length
+	align(alignment(sig[0]));
+	arr._start = size();
+
+	return arr;
+}
+
+BodyWriter BodyWriter::new_variant(const char *sig)
+{
+	if (_records) _root->_sig += DBUS_TYPE_VARIANT;
+
+	BodyWriter var(_root, DBUS_TYPE_VARIANT, false);
+
+	unsigned char l = strlen(sig);
+
+	put(&l, sizeof(l));
+	put(sig, l + 1);
+
+	return var;
+}
+
+BodyWriter BodyWriter::new_struct()
+{
+	if (_records) _root->_sig += DBUS_STRUCT_BEGIN_CHAR;
+
+	BodyWriter stu(_root, DBUS_TYPE_STRUCT, _records);
+
+	align(8);
+	return stu;
+}
+
+BodyWriter BodyWriter::new_dict_entry()
+{
+	BodyWriter ent(_root, DBUS_TYPE_DICT_ENTRY, false);
+
+	align(8);
+	return ent;
+}
+
+void BodyWriter::close_container(BodyWriter &container)
+{
+	switch (container._container)
+	{
+		case DBUS_TYPE_ARRAY:
+		{
+			dbus_uint32_t len = size() - container._start;
+
+			memcpy(&_root->_body[container._len_at], &len, sizeof(len));
+			break;
+		}
+		case DBUS_TYPE_STRUCT:
+		{
+			if (container._records) _root->_sig += DBUS_STRUCT_END_CHAR;
+			break;
+		}
+	}
+}
+
+void BodyWriter::copy_data(MessageIter &from)
+{
+	for (; !from.at_end(); ++from)
+	{
+		switch (from.type())
+		{
+			case DBUS_TYPE_BYTE:        append_byte(from.get_byte());           break;
+			case DBUS_TYPE_BOOLEAN:     append_bool(from.get_bool());           break;
+			case DBUS_TYPE_INT16:       append_int16(from.get_int16());         break;
+			case DBUS_TYPE_UINT16:      append_uint16(from.get_uint16());       break;
+			case DBUS_TYPE_INT32:       append_int32(from.get_int32());         break;
+			case DBUS_TYPE_UINT32:      append_uint32(from.get_uint32());       break;
+			case DBUS_TYPE_INT64:       append_int64(from.get_int64());         break;
+			case DBUS_TYPE_UINT64:      append_uint64(from.get_uint64());       break;
+			case DBUS_TYPE_DOUBLE:      append_double(from.get_double());       break;
+			case DBUS_TYPE_STRING:      append_string(from.get_string());       break;
+			case DBUS_TYPE_OBJECT_PATH: append_path(from.get_path());           break;
+			case DBUS_TYPE_SIGNATURE:   append_signature(from.get_signature()); break;
+
+			case DBUS_TYPE_UNIX_FD:
+				throw ErrorInvalidArgs("unix fds can't be written to a BodyWriter");
+
+			default:
+			{
+				MessageIter from_container = from.recurse();
+				char *sig = from_container.signature();
+				BodyWriter to_container;
+
+				switch (from.type())
+				{
+					case DBUS_TYPE_ARRAY:   to_container = new_array(sig);   break;
+					case DBUS_TYPE_VARIANT: to_container = new_variant(sig); break;
+					case DBUS_TYPE_STRUCT:  to_container = new_struct();     break;
+					default:                to_container = new_dict_entry(); break;
+				}
+				free(sig);
+
+				to_container.copy_data(from_container);
+				close_container(to_container);
+			}
+		}
+	}
+}
+
+/*	the message is marshalled (it has no body yet, so that's just its
+	header), given a signature field and the new body, and then parsed
+	back by libdbus, which validates the whole thing on the way in
+*/
+void BodyWriter::attach(Message &msg) const
+{
+	DBusMessage *target = msg._pvt->msg;
+
+	if (*dbus_message_get_signature(target))
+		throw ErrorInvalidArgs("message already has a body");
+
+	char *marshalled;
+	int marshalled_len;
+
+	if (!dbus_message_marshal(target, &marshalled, &marshalled_len))
+		throw ErrorNoMemory("unable to marshal message");
+
+	std::string header(marshalled, marshalled_len);
+	dbus_free(marshalled);
+
+	if (header[0] != byte_order())
+		throw ErrorInvalidArgs("message byte order doesn't match");
+
+	dbus_uint32_t serial, fields_len;
+	memcpy(&serial, &header[8], sizeof(serial));
+	memcpy(&fields_len, &header[12], sizeof(fields_len));
+
+	std::string buf(header, 0, 16);
+
+	// keep all the header fields but a stale signature
+	size_t p = 16, end = 16 + fields_len;
+	while (p < end)
+	{
+		size_t f = p;
+		char code = header[p];
+		char type = header[p + 2];
+
+		p += 4;	// field code, and a single type signature
+		switch (type)
+		{
+			case DBUS_TYPE_SIGNATURE:
+				p += 1 + (unsigned char) header[p] + 1;
+				break;
+			case DBUS_TYPE_UINT32:
+				p += 4;
+				break;
+			default:	// strings and object paths
+			{
+				dbus_uint32_t len;
+				memcpy(&len, &header[p], sizeof(len));
+				p += 4 + len + 1;
+			}
+		}
+		if (code != DBUS_HEADER_FIELD_SIGNATURE)
+		{
+			buf.append(header, f, p - f);
+			buf.resize((buf.size() + 7) & ~7, '\0');
+		}
+		p = (p + 7) & ~7;
+	}
+
+	const std::string &sig = signature();
+
+	buf += (char) DBUS_HEADER_FIELD_SIGNATURE;
+	buf += "\1g";
+	buf += '\0';
+	buf += (char) sig.length();
+	buf += sig;
+	buf += '\0';
+
+	fields_len = buf.size() - 16;
+	memcpy(&buf[12], &fields_len, sizeof(fields_len));
+
+	buf.resize((buf.size() + 7) & ~7, '\0');
+
+	dbus_uint32_t body_len = size();
+	memcpy(&buf[4], &body_len, sizeof(body_len));
+
+	// libdbus refuses to load a message without a serial
+	if (!serial)
+	{
+		dbus_uint32_t one = 1;
+		memcpy(&buf[8], &one, sizeof(one));
+	}
+
+	buf.append(data(), size());
+
+	InternalError e;
+	DBusMessage *loaded = dbus_message_demarshal(buf.data(), buf.size(), e);
+
+	if (e) throw Error(e);
+
+	// copies don't keep the serial, so the message gets a fresh one when sent
+	if (!serial)
+	{
+		DBusMessage *copy = dbus_message_copy(loaded);
+		dbus_message_unref(loaded);
+
+		if (!copy) throw ErrorNoMemory("unable to copy message");
+
+		loaded = copy;
+	}
+
+	dbus_message_unref(msg._pvt->msg);
+	msg._pvt->msg = loaded;
+}
+
+void BodyWriter::clear()
+{
+	_root->_body.clear();
+	_root->_sig.clear();
+}
+
+/*
+*/
+
+SignaturePlan::SignaturePlan(const char *sig)
+: _sig(sig)
+{
+	if (!dbus_signature_validate(sig, NULL))
+		throw ErrorInvalidArgs("invalid signature");
+
+	if (strchr(sig, DBUS_TYPE_UNIX_FD))
+		throw ErrorInvalidArgs("unix fds can't be read by a BodyReader");
+
+	_ops.resize(_sig.length());
+
+	for (size_t i = 0; i < _ops.size(); i = compile(i));
+}
+
+/*	fills in the ops of the complete type starting at i, and returns the
+	index right after it
+*/
+size_t SignaturePlan::compile(size_t i)
+{
+	char type = _sig[i];
+	size_t next = i + 1;
+	size_t size = fixed_size(type);
+
+	switch (type)
+	{
+		case DBUS_TYPE_ARRAY:
+		{
+			next = compile(i + 1);
+			break;
+		}
+		case DBUS_STRUCT_BEGIN_CHAR:
+		case DBUS_DICT_ENTRY_BEGIN_CHAR:
+		{
+			// members are laid out from an 8 byte boundary, so a struct made
+			// of fixed size members has a fixed size too
+			bool is_fixed = true;
+
+			while (_sig[next] != DBUS_STRUCT_END_CHAR && _sig[next] != DBUS_DICT_ENTRY_END_CHAR)
+			{
+				size_t member = next;
+
+				next = compile(member);
+
+				if (!_ops[member].size)
+					is_fixed = false;
+				if (is_fixed)
+					size = ((size + _ops[member].align - 1) & ~(_ops[member].align - 1)) + _ops[member].size;
+			}
+			if (!is_fixed)
+				size = 0;
+
+			Op &end = _ops[next];
+			end.type = _sig[next];
+			end.align = 1;
+			end.next = next + 1;
+			end.size = 0;
+
+			++next;
+			break;
+		}
+	}
+
+	Op &op = _ops[i];
+	op.type = type;
+	op.align = alignment(type);
+	op.next = next;
+	op.size = size;
+
+	return next;
+}
+
+/*
+*/
+
+BodyReader::BodyReader(const Message &msg, const SignaturePlan &plan)
+: _buf(NULL), _pos(0), _end(0), _swap(false), _owned(true)
+{
+	DBusMessage *source = msg._pvt->msg;
+
+	const std::string &expected = plan.signature();
+
+	if (strncmp(expected.c_str(), dbus_message_get_signature(source), expected.length()))
+		throw ErrorInvalidArgs("unexpected message signature");
+
+	int len;
+
+	if (!dbus_message_marshal(source, &_buf, &len))
+		throw ErrorNoMemory("unable to marshal message");
+
+	_swap = _buf[0] != byte_order();
+
+	uint32_t body_len, fields_len;
+	memcpy(&body_len, _buf + 4, sizeof(body_len));
+	memcpy(&fields_len, _buf + 12, sizeof(fields_len));
+
+	if (_swap)
+	{
+		swap(&body_len, 1, sizeof(body_len));
+		swap(&fields_len, 1, sizeof(fields_len));
+	}
+
+	_pos = (16 + fields_len + 7) & ~7;
+	_end = _pos + body_len;
+}
+
+BodyReader::BodyReader(const char *body, size_t len)
+: _buf(const_cast<char *>(body)), _pos(0), _end(len), _swap(false), _owned(false)
+{
+}
+
+BodyReader::~BodyReader()
+{
+	if (_owned) dbus_free(_buf);
+}
+
+void BodyReader::overrun()
+{
+	throw ErrorInvalidArgs("read past the end of the message body");
+}
+
+void BodyReader::swap(void *ptr, size_t count, size_t size)
+{
+	char *p = static_cast<char *>(ptr);
+
+	for (size_t n = 0; n < count; ++n, p += size)
+	{
+		for (size_t i = 0; i < size / 2; ++i)
+		{
+			char c = p[i];
+			p[i] = p[size - 1 - i];
+			p[size - 1 - i] = c;
+		}
+	}
+}
+
+const char *BodyReader::get_string(size_t *len)
+{
+	uint32_t l = get_uint32();
+
+	need(l + 1);
+
+	const char *chars = _buf + _pos;
+	_pos += l + 1;
+
+	if (len) *len = l;
+	return chars;
+}
+
+const char *BodyReader::get_signature()
+{
+	uint8_t l = get_byte();
+
+	need(l + 1);
+
+	const char *chars = _buf + _pos;
+	_pos += l + 1;
+	return chars;
+}
+
+size_t BodyReader::begin_array(char type)
+{
+	uint32_t len = get_uint32();
+
+	// the padding before the first element doesn't count in the length
+	align(alignment(type));
+	need(len);
+
+	return _pos + len;
+}
+
+const void *BodyReader::get_array(char type, size_t *count)
+{
+	size_t end = begin_array(type);
+	const void *elements = _buf + _pos;
+
+	*count = (end - _pos) / fixed_size(type);
+	_pos = end;
+
+	return elements;
+}
+
+void BodyReader::copy_value(const char *sig, BodyWriter &to)
+{
+	SignaturePlan plan(sig);
+
+	copy(plan, 0, to);
+}
+
+void BodyReader::copy(const SignaturePlan &plan, size_t i, BodyWriter &to)
+{
+	const SignaturePlan::Op &op = plan[i];
+
+	switch (op.type)
+	{
+		case DBUS_TYPE_BYTE:        to.append_byte(get_byte());           break;
+		case DBUS_TYPE_BOOLEAN:     to.append_bool(get_bool());           break;
+		case DBUS_TYPE_INT16:       to.append_int16(get_int16());         break;
+		case DBUS_TYPE_UINT16:      to.append_uint16(get_uint16());       break;
+		case DBUS_TYPE_INT32:       to.append_int32(get_int32());         break;
+		case DBUS_TYPE_UINT32:      to.append_uint32(get_uint32());       break;
+		case DBUS_TYPE_INT64:       to.append_int64(get_int64());         break;
+		case DBUS_TYPE_UINT64:      to.append_uint64(get_uint64());       break;
+		case DBUS_TYPE_DOUBLE:      to.append_double(get_double());       break;
+		case DBUS_TYPE_STRING:      to.append_string(get_string());       break;
+		case DBUS_TYPE_OBJECT_PATH: to.append_path(get_path());           break;
+		case DBUS_TYPE_SIGNATURE:   to.append_signature(get_signature()); break;
+
+		case DBUS_TYPE_ARRAY:
+		{
+			const std::string &sig = plan.signature();
+			std::string element(sig, i + 1, op.next - i - 1);
+
+			BodyWriter arr = to.new_array(element.c_str());
+			size_t end = begin_array(element[0]);
+
+			while (!at_end(end))
+				copy(plan, i + 1, arr);
+
+			to.close_container(arr);
+			break;
+		}
+		case DBUS_TYPE_VARIANT:
+		{
+			const char *sig = get_signature();
+			SignaturePlan inner(sig);
+
+			BodyWriter var = to.new_variant(sig);
+			copy(inner, 0, var);
+			to.close_container(var);
+			break;
+		}
+		case DBUS_STRUCT_BEGIN_CHAR:
+		case DBUS_DICT_ENTRY_BEGIN_CHAR:
+		{
+			BodyWriter stu = op.type == DBUS_STRUCT_BEGIN_CHAR ? to.new_struct() : to.new_dict_entry();
+
+			begin_struct();
+
+			for (size_t m = i + 1; m + 1 < op.next; m = plan[m].next)
+				copy(plan, m, stu);
+
+			to.close_container(stu);
+			break;
+		}
+	}
+}
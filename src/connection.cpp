@@ -64,6 +64,14 @@ Connection::Private::~Private()
 
 	detach_server();
 
+	water_mutex.lock();
+	bool was_congested = congested;
+	water_mutex.unlock();
+
+	// the dispatcher may be checking it, this waits until it's done
+	if (was_congested && dispatcher)
+		dispatcher->forget_congested(this);
+
 	if (dbus_connection_get_is_connected(conn))
 	{
 		std::vector<std::string>::iterator i = names.begin();
@@ -76,6 +84,14 @@ Connection::Private::~Private()
 		}
 		dbus_connection_close(conn);
 	}
+	dbus_connection_remove_filter(conn, SignalRouter::filter_stub, &signals);
+
+	for (size_t i = 0; i < match_calls.size(); ++i)
+	{
+		dbus_pending_call_cancel(match_calls[i]);
+		dbus_pending_call_unref(match_calls[i]);
+	}
+
 	dbus_connection_unref(conn);
 }
 
@@ -89,9 +105,169 @@ void Connection::Private::init()
 	);
 
 	dbus_connection_add_filter(conn, message_filter_stub, &disconn_filter, NULL); // TODO: some assert at least
+	dbus_connection_add_filter(conn, SignalRouter::filter_stub, &signals, NULL);
 
 	dbus_connection_set_dispatch_status_function(conn, dispatch_status_stub, this, 0);
 	dbus_connection_set_exit_on_disconnect(conn, false); //why was this set to true??
+
+	corks = 0;
+
+	high_water = low_water = 0;
+	congested = false;
+	congestion = new CongestionEvents;
+}
+
+void CongestionEvents::deliver()
+{
+	mutex.lock();
+
+	// the one telling already will get to ours too
+	if (delivering)
+	{
+		mutex.unlock();
+		return;
+	}
+
+	delivering = true;
+
+	while (!changes.empty())
+	{
+		bool now = changes.front();
+		changes.pop_front();
+
+		CongestionSlot h = handler;
+
+		mutex.unlock();
+
+		if (!h.empty())
+		{
+			try
+			{
+				h(now);
+			}
+			catch (...)
+			{
+				mutex.lock();
+				delivering = false;
+				mutex.unlock();
+				throw;
+			}
+		}
+
+		mutex.lock();
+	}
+
+	delivering = false;
+
+	mutex.unlock();
+}
+
+/*	with water_mutex held, true if the flag changed with the queue grown or
+	shrunk to size; the change is left for the handler
+*/
+bool Connection::Private::check_water(long size)
+{
+	bool was = congested;
+
+	// watermarks turned off leave it no longer congested
+	if (!congested && high_water > 0 && size > high_water)
+		congested = true;
+	else if (congested && (high_water <= 0 || size < low_water))
+		congested = false;
+
+	if (congested == was)
+		return false;
+
+	debug_log("%p: %s, %ld bytes waiting", conn, congested ? "congested" : "no longer congested", size);
+
+	congestion->mutex.lock();
+	congestion->changes.push_back(congested);
+	congestion->mutex.unlock();
+
+	return true;
+}
+
+/*	after something was sent, the connection may have gone past its high
+	watermark, the dispatcher then keeps an eye on it until it drains; it
+	may as well have drained, libdbus writes what it can straight away
+*/
+void Connection::Private::check_outgoing()
+{
+	long size = dbus_connection_get_outgoing_size(conn);
+
+	water_mutex.lock();
+
+	bool crossed = congested
+		? high_water <= 0 || size < low_water
+		: high_water > 0 && size > high_water;
+
+	water_mutex.unlock();
+
+	if (!crossed)
+		return;
+
+	if (dispatcher)
+	{
+		dispatcher->update_congested(this, size);
+		return;
+	}
+
+	water_mutex.lock();
+
+	bool changed = check_water(size);
+	RefPtr<CongestionEvents> events = congestion;
+
+	water_mutex.unlock();
+
+	if (changed)
+		events->deliver();
+}
+
+/*	keeps msg aside if the connection is corked, false if it isn't
+*/
+bool Connection::Private::cork(const Message &msg)
+{
+	cork_mutex.lock();
+
+	bool held = corks > 0;
+
+	if (held)
+		corked.push_back(msg);
+
+	cork_mutex.unlock();
+
+	return held;
+}
+
+/*	queues the messages held back so far, in order; the lock is kept
+	meanwhile so that nothing sent from another thread gets in between
+*/
+bool Connection::Private::uncork()
+{
+	cork_mutex.lock();
+
+	bool ok = send_corked();
+
+	cork_mutex.unlock();
+
+	return ok;
+}
+
+/*	with cork_mutex held, callers check the watermarks once it's released
+*/
+bool Connection::Private::send_corked()
+{
+	bool ok = true;
+
+	for (size_t i = 0; i < corked.size(); ++i)
+		ok = dbus_connection_send(conn, corked[i]._pvt->msg, NULL) && ok;
+
+	corked.clear();
+
+	if (!ok)
+		debug_log("%p: out of memory queuing held back messages", conn);
+
+	return ok;
 }
 
 void Connection::Private::detach_server()
@@ -115,10 +291,15 @@ void Connection::Private::detach_server()
 	}*/
 }
 
+/*	the handlers may have changed match rules, those go out before we're
+	done too
+*/
 bool Connection::Private::do_dispatch()
 {
 	debug_log("dispatching on %p", conn);
 
+	send_matches();
+
 	if (!dbus_connection_get_is_connected(conn))
 	{
 		debug_log("connection terminated");
@@ -128,7 +309,11 @@ bool Connection::Private::do_dispatch()
 		return true;
 	}
 
-	return dbus_connection_dispatch(conn) != DBUS_DISPATCH_DATA_REMAINS;
+	bool done = dbus_connection_dispatch(conn) != DBUS_DISPATCH_DATA_REMAINS;
+
+	send_matches();
+
+	return done;
 }
 
 void Connection::Private::dispatch_status_stub(DBusConnection *dc, DBusDispatchStatus status, void *data)
@@ -182,7 +367,7 @@ DBusDispatchStatus Connection::Private::dispatch_status()
 
 bool Connection::Private::has_something_to_dispatch()
 {
-	return dispatch_status() == DBUS_DISPATCH_DATA_REMAINS;
+	return dispatch_status() == DBUS_DISPATCH_DATA_REMAINS || matches_queued();
 }
 
 
@@ -314,7 +499,11 @@ const char *Connection::unique_name() const
 
 void Connection::flush()
 {
+	_pvt->uncork();
+
 	dbus_connection_flush(_pvt->conn);
+
+	_pvt->check_outgoing();
 }
 
 void Connection::add_match(const char *rule)
@@ -339,6 +528,205 @@ void Connection::remove_match(const char *rule)
 	if (e) throw Error(e);
 }
 
+/*	a change cancelling one still queued takes it back instead; the
+	connection is queued for dispatching so that the change goes out with
+	whatever else is made before then
+*/
+void Connection::Private::change_match(const std::string &rule, bool add)
+{
+	match_mutex.lock();
+
+	int &refs = match_refs[rule];
+
+	if (add ? refs++ > 0 : (refs == 0 || --refs > 0))
+	{
+		if (refs == 0)
+			match_refs.erase(rule);
+
+		match_mutex.unlock();
+		return;
+	}
+
+	if (refs == 0)
+		match_refs.erase(rule);
+
+	bool queued = false;
+
+	for (size_t i = 0; i < match_changes.size(); ++i)
+	{
+		if (match_changes[i].first == rule)
+		{
+			match_changes.erase(match_changes.begin() + i);
+			queued = true;
+			break;
+		}
+	}
+
+	if (!queued)
+		match_changes.push_back(std::make_pair(rule, add));
+
+	match_mutex.unlock();
+
+	if (queued)
+		return;
+
+	if (dispatcher)
+	{
+		dispatcher->queue_connection(this);
+		dispatcher->wake_up();
+	}
+	else
+		send_matches();
+}
+
+bool Connection::Private::matches_queued()
+{
+	match_mutex.lock();
+	bool queued = !match_changes.empty();
+	match_mutex.unlock();
+
+	return queued;
+}
+
+/*	all the queued changes go out back to back, their replies are only
+	waited for by Connection::sync_matches(); a batch is sent whole before
+	the next one is taken, else an add and a remove of the same rule could
+	be overtaken by each other
+*/
+void Connection::Private::send_matches()
+{
+	std::vector< std::pair<std::string, bool> > changes;
+
+	match_send_mutex.lock();
+
+	match_mutex.lock();
+	changes.swap(match_changes);
+	match_mutex.unlock();
+
+	for (size_t i = 0; i < changes.size(); ++i)
+	{
+		const char *rule = changes[i].first.c_str();
+
+		DBusMessage *msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+			DBUS_INTERFACE_DBUS, changes[i].second ? "AddMatch" : "RemoveMatch");
+		DBusPendingCall *pending = NULL;
+
+		if (!msg || !dbus_message_append_args(msg, DBUS_TYPE_STRING, &rule, DBUS_TYPE_INVALID)
+		 || !dbus_connection_send_with_reply(conn, msg, &pending, -1) || !pending)
+		{
+			if (msg)
+				dbus_message_unref(msg);
+
+			match_mutex.lock();
+			if (match_error_name.empty())
+			{
+				match_error_name = DBUS_ERROR_NO_MEMORY;
+				match_error_message = "unable to send match rule change";
+			}
+			match_mutex.unlock();
+			continue;
+		}
+
+		dbus_message_unref(msg);
+
+		debug_log("%p: %s match rule %s", conn, changes[i].second ? "adding" : "removing", rule);
+
+		match_mutex.lock();
+		match_calls.push_back(pending);
+		match_mutex.unlock();
+
+		// the reply may have been read by another thread already, the
+		// notification is then never made
+		dbus_pending_call_ref(pending);
+		dbus_pending_call_set_notify(pending, match_reply_stub, this, NULL);
+
+		if (dbus_pending_call_get_completed(pending))
+			match_reply_stub(pending, this);
+
+		dbus_pending_call_unref(pending);
+	}
+
+	match_send_mutex.unlock();
+}
+
+void Connection::Private::match_reply_stub(DBusPendingCall *pending, void *data)
+{
+	Private *p = static_cast<Private *>(data);
+
+	DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+
+	p->match_mutex.lock();
+
+	if (reply && dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR && p->match_error_name.empty())
+	{
+		const char *message = NULL;
+
+		dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &message, DBUS_TYPE_INVALID);
+
+		p->match_error_name = dbus_message_get_error_name(reply);
+		p->match_error_message = message ? message : "";
+	}
+
+	for (size_t i = 0; i < p->match_calls.size(); ++i)
+	{
+		if (p->match_calls[i] == pending)
+		{
+			p->match_calls.erase(p->match_calls.begin() + i);
+			dbus_pending_call_unref(pending);
+			break;
+		}
+	}
+
+	p->match_mutex.unlock();
+
+	if (reply)
+		dbus_message_unref(reply);
+}
+
+void Connection::add_match_async(const char *rule)
+{
+	_pvt->change_match(rule, true);
+}
+
+void Connection::remove_match_async(const char *rule)
+{
+	_pvt->change_match(rule, false);
+}
+
+void Connection::sync_matches()
+{
+	_pvt->send_matches();
+
+	std::vector<DBusPendingCall *> calls;
+
+	_pvt->match_mutex.lock();
+
+	calls = _pvt->match_calls;
+
+	for (size_t i = 0; i < calls.size(); ++i)
+		dbus_pending_call_ref(calls[i]);
+
+	_pvt->match_mutex.unlock();
+
+	for (size_t i = 0; i < calls.size(); ++i)
+	{
+		dbus_pending_call_block(calls[i]);
+		dbus_pending_call_unref(calls[i]);
+	}
+
+	_pvt->match_mutex.lock();
+
+	std::string name, message;
+
+	name.swap(_pvt->match_error_name);
+	message.swap(_pvt->match_error_message);
+
+	_pvt->match_mutex.unlock();
+
+	if (!name.empty())
+		throw Error(name.c_str(), message.c_str());
+}
+
 bool Connection::add_filter(MessageSlot &s)
 {
 	debug_log("%s: adding filter", unique_name());
@@ -353,13 +741,71 @@ void Connection::remove_filter(MessageSlot &s)
 
 bool Connection::send(const Message &msg, unsigned int *serial)
 {
-	return dbus_connection_send(_pvt->conn, msg._pvt->msg, serial);
+	if (!serial && _pvt->cork(msg))
+		return true;
+
+	// the serial is only known once the message is queued, which has to
+	// come after those held back
+	if (serial)
+		_pvt->uncork();
+
+	bool ok = dbus_connection_send(_pvt->conn, msg._pvt->msg, serial);
+
+	_pvt->check_outgoing();
+
+	return ok;
+}
+
+bool Connection::send_batch(const std::vector<Message> &msgs)
+{
+	bool ok = true;
+
+	_pvt->cork_mutex.lock();
+
+	if (_pvt->corks > 0)
+	{
+		_pvt->corked.insert(_pvt->corked.end(), msgs.begin(), msgs.end());
+	}
+	else
+	{
+		for (size_t i = 0; i < msgs.size(); ++i)
+			ok = dbus_connection_send(_pvt->conn, msgs[i]._pvt->msg, NULL) && ok;
+	}
+
+	_pvt->cork_mutex.unlock();
+
+	_pvt->check_outgoing();
+
+	return ok;
+}
+
+Connection::Cork::Cork(Connection &conn)
+: _conn(conn)
+{
+	_conn._pvt->cork_mutex.lock();
+	++_conn._pvt->corks;
+	_conn._pvt->cork_mutex.unlock();
+}
+
+Connection::Cork::~Cork()
+{
+	_conn._pvt->cork_mutex.lock();
+
+	if (--_conn._pvt->corks == 0)
+		_conn._pvt->send_corked();
+
+	_conn._pvt->cork_mutex.unlock();
+
+	// unlocked, the handler may well send more
+	_conn._pvt->check_outgoing();
 }
 
 Message Connection::send_blocking(Message &msg, int timeout)
 {
 	DBusMessage *reply;
 	InternalError e;
+
+	_pvt->uncork();
 	
 	if (this->_timeout != -1)
 	{
@@ -370,6 +816,9 @@ Message Connection::send_blocking(Message &msg, int timeout)
 		reply = dbus_connection_send_with_reply_and_block(_pvt->conn, msg._pvt->msg, timeout, e);
 	}
 
+	// the call was written out while blocking, the queue with it
+	_pvt->check_outgoing();
+
 	if (e) throw Error(e);
 
 	return Message(new Message::Private(reply), false);
@@ -379,12 +828,16 @@ PendingCall *Connection::send_async(Message &msg, int timeout)
 {
 	DBusPendingCall *pending;
 
+	_pvt->uncork();
+
 	// TODO(ers) At the moment using a timeout other than -1
 	// results in a deadlock if the timeout expires.
 	if (!dbus_connection_send_with_reply(_pvt->conn, msg._pvt->msg, &pending, timeout))
 	{
 		throw ErrorNoMemory("Unable to start asynchronous call");
 	}
+
+	_pvt->check_outgoing();
 	return new PendingCall(new PendingCall::Private(pending));
 }
 
@@ -463,3 +916,59 @@ int Connection::get_timeout()
 {
 	return _timeout;
 }
+
+long Connection::outgoing_size()
+{
+	return dbus_connection_get_outgoing_size(_pvt->conn);
+}
+
+void Connection::set_watermarks(long high, long low)
+{
+	_pvt->water_mutex.lock();
+	_pvt->high_water = high;
+	_pvt->low_water = low < high ? low : high;
+	_pvt->water_mutex.unlock();
+}
+
+bool Connection::is_congested()
+{
+	_pvt->water_mutex.lock();
+	bool congested = _pvt->congested;
+	_pvt->water_mutex.unlock();
+
+	return congested;
+}
+
+void Connection::set_congestion_handler(const CongestionSlot &handler)
+{
+	_pvt->congestion->mutex.lock();
+	_pvt->congestion->handler = handler;
+	_pvt->congestion->mutex.unlock();
+}
+
+void Connection::set_max_received_size(long size)
+{
+	dbus_connection_set_max_received_size(_pvt->conn, size);
+}
+
+long Connection::get_max_received_size()
+{
+	return dbus_connection_get_max_received_size(_pvt->conn);
+}
+
+// libdbus 1.2.16 does not have unix fd passing
+void Connection::set_max_received_unix_fds(long n)
+{
+#ifdef DBUS_TYPE_UNIX_FD
+	dbus_connection_set_max_received_unix_fds(_pvt->conn, n);
+#endif
+}
+
+long Connection::get_max_received_unix_fds()
+{
+#ifdef DBUS_TYPE_UNIX_FD
+	return dbus_connection_get_max_received_unix_fds(_pvt->conn);
+#else
+	return 0;
+#endif
+}
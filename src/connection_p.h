@@ -32,15 +32,40 @@
 #include <dbus-c++/connection.h>
 #include <dbus-c++/server.h>
 #include <dbus-c++/dispatcher.h>
+#include <dbus-c++/eventloop.h>
 #include <dbus-c++/refptr_impl.h>
 
 #include <dbus/dbus.h>
 
+#include "object_p.h"
+
+#include <deque>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace DBus {
 
-struct DXXAPILOCAL Connection::Private
+/*	changes of congestion waiting for the handler, told one at a time in
+	the order they happened by whichever thread gets to it first; shared
+	with the dispatcher, which may be left to tell after the connection
+	is gone
+*/
+struct DXXAPILOCAL CongestionEvents
+{
+	DefaultMutex mutex;
+	std::deque<bool> changes;
+	bool delivering;
+	CongestionSlot handler;
+
+	CongestionEvents() : delivering(false)
+	{}
+
+	void deliver();
+};
+
+struct DXXAPILOCAL Connection::Private : Dispatcher::PendingLink
 {
 	DBusConnection *	conn;
 
@@ -55,6 +80,50 @@ struct DXXAPILOCAL Connection::Private
 	Server::Private *server;
 	void detach_server();
 
+	ObjectTree objects;
+
+	SignalRouter signals;
+
+	/*	messages held back by Connection::Cork
+	*/
+	DefaultMutex cork_mutex;
+	int corks;
+	std::vector<Message> corked;
+
+	bool cork(const Message &);
+	bool uncork();
+	bool send_corked();
+
+	/*	outgoing watermarks, see Connection::set_watermarks(); the flag
+		only changes with the dispatcher's list of congested connections
+		locked too, so that both agree
+	*/
+	DefaultMutex water_mutex;
+	long high_water;
+	long low_water;
+	bool congested;
+	RefPtr<CongestionEvents> congestion;
+
+	void check_outgoing();
+	bool check_water(long size);
+
+	/*	match rules by reference count, see Connection::add_match_async();
+		changes wait to be sent until the connection is dispatched
+	*/
+	DefaultMutex match_mutex;
+	DefaultMutex match_send_mutex;	// keeps the changes in order on the wire
+	std::map<std::string, int> match_refs;
+	std::vector< std::pair<std::string, bool> > match_changes;
+	std::vector<DBusPendingCall *> match_calls;
+	std::string match_error_name;
+	std::string match_error_message;
+
+	void change_match(const std::string &rule, bool add);
+	void send_matches();
+	bool matches_queued();
+
+	static void match_reply_stub(DBusPendingCall *, void *);
+
 	Private(DBusConnection *, Server::Private * = NULL);
 
 	Private(DBusBusType);
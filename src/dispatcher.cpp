@@ -26,6 +26,7 @@
 #endif
 
 #include <cassert>
+#include <time.h>
 
 #include <dbus-c++/dispatcher.h>
 
@@ -64,7 +65,7 @@ bool Timeout::handle()
 */
 
 Watch::Watch(Watch::Internal *i)
-: _int(i)
+: _int(i), _disp(NULL)
 {
 	dbus_watch_set_data((DBusWatch *)i, this, NULL);
 }
@@ -90,7 +91,16 @@ bool Watch::enabled() const
 
 bool Watch::handle(int flags)
 {
-	return dbus_watch_handle((DBusWatch *)_int, flags);
+	// the watch may be gone once handled
+	Dispatcher *d = _disp;
+
+	bool ok = dbus_watch_handle((DBusWatch *)_int, flags);
+
+	// writing may have brought a connection back under its low watermark
+	if (d && (flags & DBUS_WATCH_WRITABLE))
+		d->check_congested();
+
+	return ok;
 }
 
 /*
@@ -102,7 +112,7 @@ dbus_bool_t Dispatcher::Private::on_add_watch(DBusWatch *watch, void *data)
 
 	Watch::Internal *w = reinterpret_cast<Watch::Internal *>(watch);
 
-	d->add_watch(w);
+	d->add_watch(w)->_disp = d;
 
 	return true;
 }
@@ -150,59 +160,219 @@ void Dispatcher::Private::on_toggle_timeout(DBusTimeout *timeout, void *data)
 	t->toggle();
 }
 
-void Dispatcher::queue_connection(Connection::Private *cp)
+Dispatcher::Dispatcher()
+: _pending_head(&_pending_stub), _pending_tail(&_pending_stub), _pending_count(0),
+  _dispatching(false), _budget_messages(0), _budget_usecs(0)
+{}
+
+/*	the queue is the intrusive one by Dmitry Vyukov: producers swap
+	themselves in as the tail and only then link the previous tail to
+	them, the consumer walks from the head; a stub node keeps it from ever
+	being empty, so that neither side has to handle the last node
+*/
+void Dispatcher::push_pending(PendingLink *l)
 {
-	_mutex_p.lock();
-	_pending_queue.push_back(cp);
-	_mutex_p.unlock();
-}
+	__atomic_store_n(&l->next, (PendingLink *)NULL, __ATOMIC_RELAXED);
 
+	PendingLink *prev = __atomic_exchange_n(&_pending_tail, l, __ATOMIC_ACQ_REL);
 
-bool Dispatcher::has_something_to_dispatch()
+	__atomic_store_n(&prev->next, l, __ATOMIC_RELEASE);
+}
+
+/*	NULL when the queue is empty, or when a producer is half way through
+	a push; it's then seen at the next call
+*/
+Dispatcher::PendingLink *Dispatcher::pop_pending()
 {
-	_mutex_p.lock();
-	bool has_something = false;
-	for(Connection::PrivatePList::iterator it = _pending_queue.begin();
-		it != _pending_queue.end() && !has_something;
-		++it)
+	PendingLink *head = _pending_head;
+	PendingLink *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+	if (head == &_pending_stub)
+	{
+		if (!next)
+			return NULL;
+
+		_pending_head = next;
+		head = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next)
 	{
-		has_something = (*it)->has_something_to_dispatch();
+		_pending_head = next;
+		return head;
 	}
 
-	_mutex_p.unlock();
-	return has_something;
+	if (head != __atomic_load_n(&_pending_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	push_pending(&_pending_stub);
+
+	next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+	if (next)
+	{
+		_pending_head = next;
+		return head;
+	}
+	return NULL;
 }
 
+/*	may be called from any thread; a connection already queued (or being
+	dispatched, see dispatch_pending()) isn't queued twice
+*/
+void Dispatcher::queue_connection(Connection::Private *cp)
+{
+	if (__atomic_exchange_n(&cp->queued, 1, __ATOMIC_ACQ_REL))
+		return;
 
-void Dispatcher::dispatch_pending()
+	__atomic_add_fetch(&_pending_count, 1, __ATOMIC_RELEASE);
+
+	push_pending(cp);
+}
+
+/*	true when a connection is queued, even if it turns out to have
+	nothing left to dispatch
+*/
+bool Dispatcher::has_something_to_dispatch()
 {
-	_mutex_p.lock();
+	return __atomic_load_n(&_pending_count, __ATOMIC_ACQUIRE) > 0;
+}
+
+static unsigned long long now_usecs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
+/*	meant to be called from the dispatching thread
+*/
+void Dispatcher::dispatch_budget(unsigned int messages, unsigned int usecs)
+{
+	_budget_messages = messages;
+	_budget_usecs = usecs;
+}
+
+/*	one message from the connection at the head of the queue, which then
+	goes to the back of it if it has more, so that a flooded connection
+	only gets its turn like the others; we stop there when the budget is
+	spent and leave the rest for the next iteration
+*/
+void Dispatcher::dispatch_pending()
+{
 	// Reentrancy is not permitted for this function
 	assert(!_dispatching);
 	_dispatching = true;
 
-	// SEEME: dbus-glib is dispatching only one message at a time to not starve the loop/other things...
+	unsigned int dispatched = 0;
+	unsigned long long deadline = _budget_usecs ? now_usecs() + _budget_usecs : 0;
+
+	PendingLink *l;
 
-	while (_pending_queue.size() > 0)
+	while ((l = pop_pending()) != NULL)
 	{
-		Connection::PrivatePList::iterator i, j;
-		i = _pending_queue.begin();
-		while (i != _pending_queue.end())
+		Connection::Private *cp = static_cast<Connection::Private *>(l);
+
+		// still flagged as queued while it's dispatched, so that the
+		// status callback doesn't queue it behind our back
+		if (!cp->do_dispatch())
 		{
-			j = i;
-			++j;
-			_mutex_p.unlock();
-			bool done = (*i)->do_dispatch();
-			_mutex_p.lock();
-			if (done)
-				_pending_queue.erase(i);
-
-			i = j;
+			push_pending(cp);
 		}
+		else
+		{
+			__atomic_sub_fetch(&_pending_count, 1, __ATOMIC_RELEASE);
+			__atomic_store_n(&cp->queued, 0, __ATOMIC_SEQ_CST);
+
+			// in case something came in between the dispatch and now
+			if (cp->has_something_to_dispatch())
+				queue_connection(cp);
+		}
+
+		++dispatched;
+
+		if (_budget_messages && dispatched >= _budget_messages)
+			break;
+
+		if (deadline && now_usecs() >= deadline)
+			break;
 	}
 	_dispatching = false;
-	_mutex_p.unlock();
+}
+
+void Dispatcher::update_congested(Connection::Private *cp, long size)
+{
+	_mutex_c.lock();
+	cp->water_mutex.lock();
+
+	bool changed = cp->check_water(size);
+
+	if (changed)
+	{
+		if (cp->congested)
+			_congested.push_back(cp);
+		else
+			_congested.remove(cp);
+	}
+
+	RefPtr<CongestionEvents> events = cp->congestion;
+
+	cp->water_mutex.unlock();
+	_mutex_c.unlock();
+
+	if (changed)
+		events->deliver();
+}
+
+void Dispatcher::forget_congested(Connection::Private *cp)
+{
+	_mutex_c.lock();
+	_congested.remove(cp);
+	_mutex_c.unlock();
+}
+
+/*	the handlers are told once the list is unlocked, they may well send
+	more and get congested again
+*/
+void Dispatcher::check_congested()
+{
+	std::list< RefPtr<CongestionEvents> > changed;
+
+	_mutex_c.lock();
+
+	Connection::PrivatePList::iterator i = _congested.begin();
+
+	while (i != _congested.end())
+	{
+		Connection::Private *cp = *i;
+
+		long size = dbus_connection_get_outgoing_size(cp->conn);
+
+		cp->water_mutex.lock();
+
+		// those no longer congested have nothing to do here either way
+		bool stale = !cp->congested;
+		bool drained = !stale && cp->check_water(size);
+
+		if (drained)
+			changed.push_back(cp->congestion);
+
+		cp->water_mutex.unlock();
+
+		if (stale || drained)
+			i = _congested.erase(i);
+		else
+			++i;
+	}
+
+	_mutex_c.unlock();
+
+	std::list< RefPtr<CongestionEvents> >::iterator e;
+
+	for (e = changed.begin(); e != changed.end(); ++e)
+		(*e)->deliver();
 }
 
 void DBus::_init_threading()
@@ -175,6 +175,17 @@ void Ecore::BusWatch::_disable()
   ecore_main_fd_handler_del (fd_handler_error);
 }
 
+Ecore::BusDispatcher::BusDispatcher()
+: _pipe(NULL), _woken(0)
+{
+}
+
+Ecore::BusDispatcher::~BusDispatcher()
+{
+	if (_pipe)
+		ecore_pipe_del(_pipe);
+}
+
 void Ecore::BusDispatcher::attach( )
 {
 }
@@ -197,6 +208,9 @@ void Ecore::BusDispatcher::rem_timeout( Timeout* t )
 
 Watch* Ecore::BusDispatcher::add_watch( Watch::Internal* wi )
 {
+	if (!_pipe)
+		__atomic_store_n(&_pipe, ecore_pipe_add(wake_up_handler, this), __ATOMIC_RELEASE);
+
 	Watch* w = new Ecore::BusWatch(wi);
 
 	debug_log("ecore: added watch %p (%s) fd=%d flags=%d",
@@ -211,3 +225,33 @@ void Ecore::BusDispatcher::rem_watch( Watch* w )
 
 	delete w;
 }
+
+/*	ecore idlers and timers can only be added from the loop's own thread,
+	a pipe can be written to from any; only the first wakeup after the loop
+	took the last one writes anything
+*/
+void Ecore::BusDispatcher::wake_up()
+{
+	Ecore_Pipe *pipe = __atomic_load_n(&_pipe, __ATOMIC_ACQUIRE);
+
+	if (!pipe || __atomic_exchange_n(&_woken, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	char c = 0;
+	ecore_pipe_write(pipe, &c, 1);
+}
+
+void Ecore::BusDispatcher::wake_up_handler( void *data, void*, unsigned int )
+{
+	Ecore::BusDispatcher* d = reinterpret_cast<Ecore::BusDispatcher*>(data);
+
+	debug_log("ecore: woken up");
+
+	__atomic_store_n(&d->_woken, 0, __ATOMIC_RELEASE);
+
+	d->dispatch_pending();
+
+	// whatever is left over the dispatch budget waits for the next round
+	if (d->has_something_to_dispatch())
+		d->wake_up();
+}
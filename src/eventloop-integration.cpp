@@ -31,6 +31,12 @@
 #include <dbus-c++/debug.h>
 
 #include <sys/poll.h>
+#include <fcntl.h>
+#include <stdint.h>
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 
 #include <dbus/dbus.h>
 #include <errno.h>
@@ -71,6 +77,72 @@ void BusWatch::toggle()
 	DefaultWatch::enabled(Watch::enabled());
 }
 
+struct BusDispatcher::Task
+{
+	Task *next;
+	TaskSlot slot;
+	int delay;
+};
+
+BusDispatcher::BusDispatcher(backend_type backend)
+: DefaultMainLoop(backend), _running(false), _tasks(NULL), _taken(NULL), _woken(0)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	_wakefd[0] = _wakefd[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (_wakefd[0] == -1)
+#endif
+	{
+		if (pipe(_wakefd) == -1)
+		{
+			char buffer[128]; // buffer copied in Error constructor
+			throw Error("PipeError:errno", strerror_r(errno, buffer, sizeof(buffer)));
+		}
+
+		for (int i = 0; i < 2; ++i)
+		{
+			fcntl(_wakefd[i], F_SETFL, fcntl(_wakefd[i], F_GETFL) | O_NONBLOCK);
+			fcntl(_wakefd[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+
+	_wake_watch = new DefaultWatch(_wakefd[0], POLLIN, this);
+	_wake_watch->ready = new Callback<BusDispatcher, void, DefaultWatch &>(this, &BusDispatcher::tasks_ready);
+}
+
+/*	tasks not run yet are dropped
+*/
+BusDispatcher::~BusDispatcher()
+{
+	std::set<DefaultTimeout *>::iterator di;
+
+	for (di = _delayed.begin(); di != _delayed.end(); ++di)
+	{
+		delete static_cast<Task *>((*di)->data());
+		delete *di;
+	}
+
+	Task *lists[] = { __atomic_exchange_n(&_tasks, (Task *)NULL, __ATOMIC_ACQUIRE), _taken };
+
+	for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i)
+	{
+		Task *t = lists[i];
+
+		while (t)
+		{
+			Task *next = t->next;
+			delete t;
+			t = next;
+		}
+	}
+
+	delete _wake_watch;
+
+	close(_wakefd[0]);
+	if (_wakefd[1] != _wakefd[0])
+		close(_wakefd[1]);
+}
+
 void BusDispatcher::enter()
 {
 	debug_log("entering dispatcher %p", this);
@@ -88,22 +160,143 @@ void BusDispatcher::enter()
 void BusDispatcher::leave()
 {
 	_running = false;
-  
-	int ret = write(_fdunlock[1],"exit",strlen("exit"));
-	if (ret == -1) {
-          char buffer[128]; // buffer copied in Error constructor
-          throw Error("PipeError:errno", strerror_r(errno,
-                                                    buffer,
-                                                    sizeof(buffer)));
-        }
-	close(_fdunlock[1]);
-	close(_fdunlock[0]);
+
+	wake_up();
+}
+
+void BusDispatcher::post(const TaskSlot &task)
+{
+	post_delayed(task, 0);
+}
+
+void BusDispatcher::post_delayed(const TaskSlot &task, int delay)
+{
+	Task *t = new Task;
+
+	t->slot = task;
+	t->delay = delay;
+	t->next = __atomic_load_n(&_tasks, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&_tasks, &t->next, t, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	wake_up();
 }
 
+/*	only the first wakeup after the loop took the tasks writes anything,
+	the others would find it already on its way
+*/
+void BusDispatcher::wake_up()
+{
+	if (__atomic_exchange_n(&_woken, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	ssize_t ret;
+
+	if (_wakefd[1] != _wakefd[0])
+	{
+		char c = 0;
+		ret = write(_wakefd[1], &c, 1);
+	}
+	else
+	{
+		uint64_t one = 1;
+		ret = write(_wakefd[1], &one, sizeof(one));
+	}
+
+	if (ret == -1 && errno != EAGAIN)
+	{
+		char buffer[128]; // buffer copied in Error constructor
+		throw Error("PipeError:errno", strerror_r(errno, buffer, sizeof(buffer)));
+	}
+}
+
+/*	the flag is cleared before the tasks are taken, so that a task posted
+	after that sends a wakeup of its own; the tasks are only run by
+	do_iteration(), the loop may be holding its watch lock here
+*/
+void BusDispatcher::tasks_ready(DefaultWatch &)
+{
+	char buf[64];
+
+	while (read(_wakefd[0], buf, sizeof(buf)) > 0)
+		;
+
+	__atomic_store_n(&_woken, 0, __ATOMIC_SEQ_CST);
+
+	Task *t = __atomic_exchange_n(&_tasks, (Task *)NULL, __ATOMIC_ACQUIRE);
+
+	// newest first, turned around to run them in the order they came
+	Task *tasks = NULL;
+
+	while (t)
+	{
+		Task *next = t->next;
+		t->next = tasks;
+		tasks = t;
+		t = next;
+	}
+
+	Task **tail = &_taken;
+
+	while (*tail)
+		tail = &(*tail)->next;
+
+	*tail = tasks;
+}
+
+void BusDispatcher::run_tasks()
+{
+	Task *tasks = _taken;
+	_taken = NULL;
+
+	while (tasks)
+	{
+		Task *t = tasks;
+		tasks = t->next;
+
+		if (t->delay > 0)
+		{
+			DefaultTimeout *dt = new DefaultTimeout(t->delay, false, this);
+
+			dt->expired = new Callback<BusDispatcher, void, DefaultTimeout &>(this, &BusDispatcher::task_expired);
+			dt->data(t);
+
+			_delayed.insert(dt);
+			continue;
+		}
+
+		t->slot(*this);
+
+		delete t;
+	}
+}
+
+void BusDispatcher::task_expired(DefaultTimeout &dt)
+{
+	Task *t = static_cast<Task *>(dt.data());
+
+	_delayed.erase(&dt);
+	delete &dt;
+
+	t->slot(*this);
+
+	delete t;
+}
+
+/*	with a dispatch budget there may be messages left to dispatch, we then
+	only look for new events and come back to them at once
+*/
 void BusDispatcher::do_iteration()
 {
 	dispatch_pending();
-	dispatch();
+
+	if (has_something_to_dispatch())
+		dispatch(0);
+	else
+		dispatch();
+
+	run_tasks();
 }
 
 Timeout *BusDispatcher::add_timeout(Timeout::Internal *ti)
@@ -0,0 +1,470 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <cstring>
+#include <errno.h>
+#include <stdint.h>
+
+#include <dbus-c++/eventloop.h>
+#include <dbus-c++/debug.h>
+
+#include <sys/poll.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace DBus;
+
+/*
+ *   The io_uring backend, talking to the kernel directly so that there's
+ *   no extra dependency. Every enabled watch has a poll request queued on
+ *   the ring; changes to the watches only queue more requests, which go to
+ *   the kernel together with the wait for the next events, in one system
+ *   call per iteration however many watches changed or became ready.
+ *
+ *   Poll requests are one shot and queued again after the watch callback.
+ *   Multishot polls are edge triggered, and libdbus doesn't always read
+ *   everything available when a watch is handled, so a watch would never
+ *   be reported again for data already waiting on its socket.
+ */
+
+struct UringPoll;
+
+struct UringRing
+{
+	int fd;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned *sq_array;
+	io_uring_sqe *sqes;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	io_uring_cqe *cqes;
+
+	void *sq_ptr;
+	size_t sq_len;
+	void *cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+
+	unsigned pending;	// requests queued but not submitted yet
+	UringPoll *polls;	// records of the poll requests the kernel still holds
+};
+
+struct DefaultMainLoop::Ring : UringRing
+{
+};
+
+/*	what a poll request is for; the watch is cleared when the request gets
+	cancelled, the record itself goes away with its last completion or
+	with the ring, whichever comes first
+*/
+struct UringPoll
+{
+	DefaultWatch *watch;
+	int events;
+
+	UringPoll *prev;
+	UringPoll *next;
+};
+
+static void link_poll(UringRing *r, UringPoll *poll)
+{
+	poll->prev = NULL;
+	poll->next = r->polls;
+
+	if (r->polls)
+		r->polls->prev = poll;
+
+	r->polls = poll;
+}
+
+static void unlink_poll(UringRing *r, UringPoll *poll)
+{
+	if (poll->prev)
+		poll->prev->next = poll->next;
+	else
+		r->polls = poll->next;
+
+	if (poll->next)
+		poll->next->prev = poll->prev;
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argsz);
+}
+
+bool DefaultMainLoop::uring_setup()
+{
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+
+	int fd = syscall(__NR_io_uring_setup, 1024, &p);
+
+	if (fd < 0)
+		return false;
+
+	// waiting with a timeout and never losing completions are both needed
+	if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP))
+	{
+		close(fd);
+		return false;
+	}
+
+	Ring *r = new Ring;
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+		r->cq_len = r->sq_len;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+	if (r->sq_ptr == MAP_FAILED)
+	{
+		close(fd);
+		delete r;
+		return false;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		r->cq_ptr = r->sq_ptr;
+	}
+	else
+	{
+		r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+		if (r->cq_ptr == MAP_FAILED)
+		{
+			munmap(r->sq_ptr, r->sq_len);
+			close(fd);
+			delete r;
+			return false;
+		}
+	}
+
+	r->sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+	r->sqes = (io_uring_sqe *)mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+	if (r->sqes == MAP_FAILED)
+	{
+		if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+		munmap(r->sq_ptr, r->sq_len);
+		close(fd);
+		delete r;
+		return false;
+	}
+
+	char *sq = (char *)r->sq_ptr;
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_entries = *(unsigned *)(sq + p.sq_off.ring_entries);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+
+	char *cq = (char *)r->cq_ptr;
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	_ring = r;
+	return true;
+}
+
+/*	completions are only reaped by the loop, and only under _mutex_w
+*/
+static bool reap(UringRing *r, io_uring_cqe *cqe)
+{
+	unsigned head = *r->cq_head;
+
+	if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+
+	*cqe = r->cqes[head & r->cq_mask];
+	__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/*	closing the ring drops whatever polls the deleted watches left behind,
+	the kernel only ever saw their records as numbers so they can go first
+*/
+void DefaultMainLoop::uring_teardown()
+{
+	Ring *r = _ring;
+
+	while (r->polls)
+	{
+		UringPoll *poll = r->polls;
+
+		r->polls = poll->next;
+		delete poll;
+	}
+
+	munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+	munmap(r->sq_ptr, r->sq_len);
+	close(r->fd);
+
+	delete r;
+	_ring = NULL;
+}
+
+/*	requests are made visible to the kernel as they're queued, and only
+	submitted when the loop next waits, unless the ring fills up
+*/
+static io_uring_sqe *next_sqe(UringRing *r)
+{
+	unsigned tail = *r->sq_tail;
+
+	if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+	{
+		uring_enter(r->fd, r->pending, 0, 0, NULL, 0);
+		r->pending = 0;
+
+		if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+			return NULL;
+	}
+
+	io_uring_sqe *sqe = &r->sqes[tail & r->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static void queue_sqe(UringRing *r)
+{
+	unsigned tail = *r->sq_tail;
+
+	r->sq_array[tail & r->sq_mask] = tail & r->sq_mask;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++r->pending;
+}
+
+static bool queue_poll(UringRing *r, int fd, int events, __u64 data)
+{
+	io_uring_sqe *sqe = next_sqe(r);
+
+	if (!sqe)
+		return false;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->user_data = data;
+	queue_sqe(r);
+	return true;
+}
+
+void DefaultMainLoop::uring_update(DefaultWatch *w)
+{
+	int events = w->_flags & (POLLIN | POLLOUT | POLLPRI);
+
+	if (w->_poll)
+	{
+		if (w->_enabled && ((UringPoll *)w->_poll)->events == events)
+			return;
+
+		uring_forget(w);
+	}
+
+	if (!w->_enabled || !events)
+		return;
+
+	UringPoll *poll = new UringPoll;
+	poll->watch = w;
+	poll->events = events;
+
+	if (!queue_poll(_ring, w->_fd, events, (uintptr_t)poll))
+	{
+		debug_log("io_uring: cannot add watch on fd %d", w->_fd);
+		delete poll;
+		return;
+	}
+
+	link_poll(_ring, poll);
+	w->_poll = poll;
+}
+
+void DefaultMainLoop::uring_forget(DefaultWatch *w)
+{
+	UringPoll *poll = (UringPoll *)w->_poll;
+
+	if (!poll)
+		return;
+
+	poll->watch = NULL;
+	w->_poll = NULL;
+
+	io_uring_sqe *sqe = next_sqe(_ring);
+
+	// without a slot the poll stays until the socket is closed or
+	// becomes ready, it's been disowned anyway
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->addr = (uintptr_t)poll;
+	sqe->user_data = 0;
+	queue_sqe(_ring);
+}
+
+void DefaultMainLoop::uring_watches(int wait)
+{
+	Ring *r = _ring;
+
+	_mutex_w.lock();
+
+	unsigned submit = r->pending;
+	r->pending = 0;
+
+	_mutex_w.unlock();
+
+	__kernel_timespec ts;
+	ts.tv_sec = wait / 1000;
+	ts.tv_nsec = (wait % 1000) * 1000000L;
+
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (uintptr_t)&ts;
+
+	// submits everything queued and waits, in the same call
+	uring_enter(r->fd, submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+	run_timeouts();
+
+	_mutex_w.lock();
+
+	_ready.clear();
+
+	io_uring_cqe cqe;
+
+	while (reap(r, &cqe))
+	{
+		// cancellations complete with no record of their own
+		if (!cqe.user_data)
+			continue;
+
+		UringPoll *poll = (UringPoll *)(uintptr_t)cqe.user_data;
+		DefaultWatch *w = poll->watch;
+
+		unlink_poll(r, poll);
+		delete poll;
+
+		if (!w)
+			continue;
+
+		w->_poll = NULL;
+
+		if (cqe.res < 0)
+		{
+			// the descriptor is gone, the watch will follow shortly
+			debug_log("io_uring: poll on fd %d failed (%s)", w->_fd, strerror(-cqe.res));
+			w->_state = POLLNVAL;
+		}
+		else
+		{
+			w->_state = cqe.res & (POLLIN | POLLOUT | POLLPRI | POLLERR | POLLHUP);
+		}
+		_ready.push_back(w);
+	}
+
+	/*	as for epoll, callbacks run unlocked; a watch still around and
+		enabled afterwards gets its poll queued again
+	*/
+	for (size_t j = 0; j < _ready.size(); ++j)
+	{
+		DefaultWatch *w = _ready[j];
+
+		if (!w)
+			continue;
+
+		if (w->_enabled && w->_state != POLLNVAL)
+		{
+			_mutex_w.unlock();
+
+			w->ready(*w);
+
+			_mutex_w.lock();
+
+			if (!_ready[j])
+				continue;
+		}
+
+		if (w->_state != POLLNVAL)
+			uring_update(w);
+	}
+
+	_ready.clear();
+
+	_mutex_w.unlock();
+}
+
+#else
+
+using namespace DBus;
+
+bool DefaultMainLoop::uring_setup()
+{
+	return false;
+}
+
+void DefaultMainLoop::uring_teardown()
+{
+}
+
+void DefaultMainLoop::uring_watches(int)
+{
+}
+
+void DefaultMainLoop::uring_update(DefaultWatch *)
+{
+}
+
+void DefaultMainLoop::uring_forget(DefaultWatch *)
+{
+}
+
+#endif//HAVE_LINUX_IO_URING_H
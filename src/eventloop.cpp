@@ -26,48 +26,93 @@
 #endif
 
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <dbus-c++/eventloop.h>
 #include <dbus-c++/debug.h>
 
 #include <sys/poll.h>
-#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include <dbus/dbus.h>
 
 using namespace DBus;
 
-static double millis(timeval tv)
+static const size_t unarmed = (size_t)-1;
+
+/*	timeouts run off the monotonic clock, so that they don't go off early
+	or late when the system time is stepped
+*/
+static double now_millis()
 {
-	return (tv.tv_sec *1000.0 + tv.tv_usec/1000.0);
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec *1000.0 + ts.tv_nsec/1000000.0;
 }
 	
 DefaultTimeout::DefaultTimeout(int interval, bool repeat, DefaultMainLoop *ed)
-: _enabled(true), _interval(interval), _repeat(repeat), _expiration(0), _data(0), _disp(ed)
+: _enabled(true), _interval(interval), _repeat(repeat), _expiration(0), _slot(unarmed), _data(0), _disp(ed)
+{
+	_disp->_mutex_t.lock();
+	_link = _disp->_timeouts.insert(_disp->_timeouts.end(), this);
+	_disp->arm(this, now_millis());
+	_disp->_mutex_t.unlock();
+}
+
+DefaultTimeout::~DefaultTimeout()
 {
-	timeval now;
-	gettimeofday(&now, NULL);
+	_disp->_mutex_t.lock();
+	_disp->_timeouts.erase(_link);
+	_disp->disarm(this);
 
-	_expiration = millis(now) + interval;
+	std::vector<DefaultTimeout *>::iterator ei;
 
+	for (ei = _disp->_expired.begin(); ei != _disp->_expired.end(); ++ei)
+	{
+		if (*ei == this) *ei = NULL;
+	}
+	_disp->_mutex_t.unlock();
+}
+
+/*	enabling a timeout (again) starts its interval over
+*/
+void DefaultTimeout::enabled(bool e)
+{
 	_disp->_mutex_t.lock();
-	_disp->_timeouts.push_back(this);
+	_enabled = e;
+
+	if (e)
+		_disp->arm(this, now_millis());
+	else
+		_disp->disarm(this);
 	_disp->_mutex_t.unlock();
 }
 
-DefaultTimeout::~DefaultTimeout()
+void DefaultTimeout::interval(int i)
 {
 	_disp->_mutex_t.lock();
-	_disp->_timeouts.remove(this);
+	_interval = i;
+
+	if (_enabled)
+		_disp->arm(this, now_millis());
 	_disp->_mutex_t.unlock();
 }
 
 DefaultWatch::DefaultWatch(int fd, int flags, DefaultMainLoop *ed)
-: _enabled(true), _fd(fd), _flags(flags), _state(0), _data(0), _disp(ed)
+: _enabled(true), _fd(fd), _flags(flags), _state(0), _efd(-1), _poll(0), _data(0), _disp(ed)
 {
 	_disp->_mutex_w.lock();
 	_disp->_watches.push_back(this);
+	_disp->update_watch(this);
 	_disp->_mutex_w.unlock();
 }
 
@@ -75,6 +120,38 @@ DefaultWatch::~DefaultWatch()
 {
 	_disp->_mutex_w.lock();
 	_disp->_watches.remove(this);
+	_disp->forget_watch(this);
+	_disp->_mutex_w.unlock();
+}
+
+/*	with poll() changes are picked up at the next iteration, and the
+	watches list may well be locked by the caller (callbacks run under it)
+*/
+void DefaultWatch::enabled(bool e)
+{
+	if (_disp->backend() == DefaultMainLoop::BACKEND_POLL)
+	{
+		_enabled = e;
+		return;
+	}
+
+	_disp->_mutex_w.lock();
+	_enabled = e;
+	_disp->update_watch(this);
+	_disp->_mutex_w.unlock();
+}
+
+void DefaultWatch::flags(int f)
+{
+	if (_disp->backend() == DefaultMainLoop::BACKEND_POLL)
+	{
+		_flags = f;
+		return;
+	}
+
+	_disp->_mutex_w.lock();
+	_flags = f;
+	_disp->update_watch(this);
 	_disp->_mutex_w.unlock();
 }
 
@@ -104,8 +181,27 @@ void DefaultMutex::unlock()
 	pthread_mutex_unlock(&_mutex);
 }
 
-DefaultMainLoop::DefaultMainLoop()
+DefaultMainLoop::DefaultMainLoop(backend_type backend)
+: _epfd(-1), _ring(NULL)
 {
+	if (backend == BACKEND_IO_URING)
+	{
+		if (uring_setup())
+			return;
+
+		debug_log("io_uring unavailable, using epoll");
+		backend = BACKEND_EPOLL;
+	}
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (backend == BACKEND_EPOLL)
+	{
+		_epfd = epoll_create1(EPOLL_CLOEXEC);
+
+		if (_epfd < 0)
+			debug_log("epoll unavailable (%s), using poll", strerror(errno));
+	}
+#endif
 }
 
 DefaultMainLoop::~DefaultMainLoop()
@@ -137,93 +233,255 @@ DefaultMainLoop::~DefaultMainLoop()
 		ti = tmp;
 	}
 	_mutex_t.unlock();
+
+	if (_ring)
+		uring_teardown();
+
+	if (_epfd >= 0)
+		close(_epfd);
+}
+
+DefaultMainLoop::backend_type DefaultMainLoop::backend() const
+{
+	if (_ring)
+		return BACKEND_IO_URING;
+
+	return _epfd < 0 ? BACKEND_POLL : BACKEND_EPOLL;
 }
 
 void DefaultMainLoop::dispatch()
 {
-	_mutex_w.lock();
+	dispatch(-1);
+}
 
-	int nfd = _watches.size();
+void DefaultMainLoop::dispatch(int max_wait)
+{
+	int wait_min = next_timeout();
+
+	if (max_wait >= 0 && max_wait < wait_min)
+		wait_min = max_wait;
+
+	if (_ring)
+		uring_watches(wait_min);
+	else if (_epfd >= 0)
+		epoll_watches(wait_min);
+	else
+		poll_watches(wait_min);
+}
+
+/*	keeps the kernel side of the loop (if there's one) in sync with a watch
+*/
+void DefaultMainLoop::update_watch(DefaultWatch *w)
+{
+	if (_ring)
+		uring_update(w);
+	else if (_epfd >= 0)
+		epoll_update(w);
+}
 
-	if(_fdunlock)
+void DefaultMainLoop::forget_watch(DefaultWatch *w)
+{
+	std::vector<DefaultWatch *>::iterator ri;
+
+	for (ri = _ready.begin(); ri != _ready.end(); ++ri)
 	{
-		nfd=nfd+2;
+		if (*ri == w) *ri = NULL;
 	}
 
-	pollfd fds[nfd];
+	if (_ring)
+		uring_forget(w);
+	else if (_epfd >= 0)
+		epoll_forget(w);
+}
 
-	DefaultWatches::iterator wi = _watches.begin();
+/*	the timer heap is a binary min-heap on the expiration time; each
+	timeout knows its own slot, so rearming or cancelling one is O(log n)
+*/
+void DefaultMainLoop::sift_up(size_t i)
+{
+	DefaultTimeout *t = _heap[i];
 
-	for (nfd = 0; wi != _watches.end(); ++wi)
+	while (i > 0)
 	{
-		if ((*wi)->enabled())
-		{
-			fds[nfd].fd = (*wi)->descriptor();
-			fds[nfd].events = (*wi)->flags();
-			fds[nfd].revents = 0;
+		size_t parent = (i - 1) / 2;
 
-			++nfd;
-		}
+		if (_heap[parent]->_expiration <= t->_expiration)
+			break;
+
+		_heap[i] = _heap[parent];
+		_heap[i]->_slot = i;
+		i = parent;
 	}
+	_heap[i] = t;
+	t->_slot = i;
+}
+
+void DefaultMainLoop::sift_down(size_t i)
+{
+	DefaultTimeout *t = _heap[i];
+	size_t n = _heap.size();
+
+	for (;;)
+	{
+		size_t child = 2 * i + 1;
 
-	if(_fdunlock){
-		fds[nfd].fd = _fdunlock[0];
-		fds[nfd].events = POLLIN | POLLOUT | POLLPRI ;
-		fds[nfd].revents = 0;
-		
-		nfd++;
-		fds[nfd].fd = _fdunlock[1];
-		fds[nfd].events = POLLIN | POLLOUT | POLLPRI ;
-		fds[nfd].revents = 0;
+		if (child >= n)
+			break;
+
+		if (child + 1 < n && _heap[child + 1]->_expiration < _heap[child]->_expiration)
+			++child;
+
+		if (t->_expiration <= _heap[child]->_expiration)
+			break;
+
+		_heap[i] = _heap[child];
+		_heap[i]->_slot = i;
+		i = child;
 	}
+	_heap[i] = t;
+	t->_slot = i;
+}
 
-	_mutex_w.unlock();
+void DefaultMainLoop::arm(DefaultTimeout *t, double now)
+{
+	t->_expiration = now + t->_interval;
 
-	int wait_min = 10000;
+	if (t->_slot == unarmed)
+	{
+		t->_slot = _heap.size();
+		_heap.push_back(t);
+		sift_up(t->_slot);
+	}
+	else
+	{
+		// the new deadline can only be later when the clock is monotonic,
+		// but a shorter interval may bring it forward
+		sift_up(t->_slot);
+		sift_down(t->_slot);
+	}
+}
+
+void DefaultMainLoop::disarm(DefaultTimeout *t)
+{
+	size_t i = t->_slot;
+
+	if (i == unarmed)
+		return;
+
+	t->_slot = unarmed;
+
+	DefaultTimeout *last = _heap.back();
+	_heap.pop_back();
 
-	DefaultTimeouts::iterator ti;
+	if (last == t)
+		return;
+
+	_heap[i] = last;
+	last->_slot = i;
+	sift_up(i);
+	sift_down(last->_slot);
+}
+
+/*	how long to wait for the earliest deadline, rounded up so that the
+	loop doesn't wake up just before it and spin
+*/
+int DefaultMainLoop::next_timeout()
+{
+	int wait_min = 10000;
 
 	_mutex_t.lock();
 
-	for (ti = _timeouts.begin(); ti != _timeouts.end(); ++ti)
+	if (!_heap.empty())
 	{
-		if ((*ti)->enabled() && (*ti)->interval() < wait_min)
-			wait_min = (*ti)->interval();
+		double wait = _heap.front()->_expiration - now_millis();
+
+		if (wait <= 0)
+			wait_min = 0;
+		else if (wait < wait_min)
+			wait_min = (int)ceil(wait);
 	}
 
 	_mutex_t.unlock();
 
-	poll(fds, nfd, wait_min);
-
-	timeval now;
-	gettimeofday(&now, NULL);
+	return wait_min;
+}
 
-	double now_millis = millis(now);
+/*	only the timeouts due when this starts are run, each one at most once;
+	repeating ones are rearmed before their callback, which runs unlocked
+	and may add, toggle or delete timeouts freely
+*/
+void DefaultMainLoop::run_timeouts()
+{
+	double now = now_millis();
 
 	_mutex_t.lock();
 
-	ti = _timeouts.begin();
+	_expired.clear();
 
-	while (ti != _timeouts.end())
+	while (!_heap.empty() && _heap.front()->_expiration <= now)
 	{
-		DefaultTimeouts::iterator tmp = ti;
-		++tmp;
+		DefaultTimeout *t = _heap.front();
 
-		if ((*ti)->enabled() && now_millis >= (*ti)->_expiration)
-		{
-			(*ti)->expired(*(*ti));
+		disarm(t);
+		_expired.push_back(t);
+	}
 
-			if ((*ti)->_repeat)
-			{
-				(*ti)->_expiration = now_millis + (*ti)->_interval;
-			}
+	// repeating timeouts keep their period instead of drifting by however
+	// late they ran, unless they've fallen a whole interval behind
+	for (size_t j = 0; j < _expired.size(); ++j)
+	{
+		DefaultTimeout *t = _expired[j];
 
-		}
+		if (t->_repeat)
+			arm(t, t->_expiration + t->_interval > now ? t->_expiration : now);
+	}
 
-		ti = tmp;
+	for (size_t j = 0; j < _expired.size(); ++j)
+	{
+		DefaultTimeout *t = _expired[j];
+
+		if (!t || !t->_enabled)
+			continue;
+
+		_mutex_t.unlock();
+
+		t->expired(*t);
+
+		_mutex_t.lock();
 	}
 
+	_expired.clear();
+
 	_mutex_t.unlock();
+}
+
+void DefaultMainLoop::poll_watches(int wait)
+{
+	_mutex_w.lock();
+
+	int nfd = _watches.size();
+
+	pollfd fds[nfd];
+
+	DefaultWatches::iterator wi = _watches.begin();
+
+	for (nfd = 0; wi != _watches.end(); ++wi)
+	{
+		if ((*wi)->enabled())
+		{
+			fds[nfd].fd = (*wi)->descriptor();
+			fds[nfd].events = (*wi)->flags();
+			fds[nfd].revents = 0;
+
+			++nfd;
+		}
+	}
+
+	_mutex_w.unlock();
+
+	poll(fds, nfd, wait);
+
+	run_timeouts();
 
 	_mutex_w.lock();
 
@@ -254,3 +512,128 @@ void DefaultMainLoop::dispatch()
 	_mutex_w.unlock();
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+
+/*	only enabled watches are kept in the epoll set: the kernel always
+	reports hangups and errors, even with no events asked for, and a
+	disabled watch on a dead socket would keep waking the loop up.
+
+	libdbus uses separate watches for reading and writing on the same
+	socket; since epoll won't take a descriptor twice the second one gets
+	registered through a duplicate, which refers to the same socket.
+*/
+void DefaultMainLoop::epoll_update(DefaultWatch *w)
+{
+	if (!w->_enabled || !w->_flags)
+	{
+		epoll_forget(w);
+		return;
+	}
+
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = w->_flags & (EPOLLIN | EPOLLOUT | EPOLLPRI);
+	ev.data.ptr = w;
+
+	if (w->_efd >= 0)
+	{
+		if (epoll_ctl(_epfd, EPOLL_CTL_MOD, w->_efd, &ev) < 0)
+			debug_log("epoll: cannot modify watch on fd %d (%s)", w->_fd, strerror(errno));
+		return;
+	}
+
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, w->_fd, &ev) == 0)
+	{
+		w->_efd = w->_fd;
+		return;
+	}
+
+	if (errno == EEXIST)
+	{
+		int fd = fcntl(w->_fd, F_DUPFD_CLOEXEC, 0);
+
+		if (fd >= 0 && epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+		{
+			w->_efd = fd;
+			return;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+	debug_log("epoll: cannot add watch on fd %d (%s)", w->_fd, strerror(errno));
+}
+
+void DefaultMainLoop::epoll_forget(DefaultWatch *w)
+{
+	if (w->_efd < 0)
+		return;
+
+	// fails harmlessly if the descriptor was already closed
+	epoll_ctl(_epfd, EPOLL_CTL_DEL, w->_efd, NULL);
+
+	if (w->_efd != w->_fd)
+		close(w->_efd);
+
+	w->_efd = -1;
+}
+
+void DefaultMainLoop::epoll_watches(int wait)
+{
+	static const int max_events = 256;
+
+	epoll_event events[max_events];
+
+	int nev = epoll_wait(_epfd, events, max_events, wait);
+
+	run_timeouts();
+
+	_mutex_w.lock();
+
+	_ready.clear();
+
+	for (int j = 0; j < nev; ++j)
+	{
+		DefaultWatch *w = static_cast<DefaultWatch *>(events[j].data.ptr);
+
+		w->_state = events[j].events & (POLLIN | POLLOUT | POLLPRI | POLLERR | POLLHUP);
+		_ready.push_back(w);
+	}
+
+	/*	callbacks run unlocked, they're free to add or remove watches; the
+		ones removed meanwhile are cleared from _ready by forget_watch()
+	*/
+	for (size_t j = 0; j < _ready.size(); ++j)
+	{
+		DefaultWatch *w = _ready[j];
+
+		if (!w || !w->_enabled)
+			continue;
+
+		_mutex_w.unlock();
+
+		w->ready(*w);
+
+		_mutex_w.lock();
+	}
+
+	_ready.clear();
+
+	_mutex_w.unlock();
+}
+
+#else
+
+void DefaultMainLoop::epoll_update(DefaultWatch *)
+{
+}
+
+void DefaultMainLoop::epoll_forget(DefaultWatch *)
+{
+}
+
+void DefaultMainLoop::epoll_watches(int wait)
+{
+	poll_watches(wait);
+}
+
+#endif//HAVE_SYS_EPOLL_H
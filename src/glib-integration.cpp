@@ -308,6 +308,12 @@ void Glib::BusDispatcher::rem_watch(Watch *w)
 	delete w;
 }
 
+void Glib::BusDispatcher::wake_up()
+{
+	if (_ctx)
+		g_main_context_wakeup(_ctx);
+}
+
 void Glib::BusDispatcher::set_priority(int priority)
 {
 	_priority = priority;
@@ -27,10 +27,13 @@
 
 #include <dbus-c++/debug.h>
 #include <dbus-c++/interface.h>
+#include <dbus-c++/object.h>
 #include <dbus-c++/pendingcall.h>
 
 #include "internalerror.h"
 
+#include <cstring>
+
 using namespace DBus;
 
 Interface::Interface(const std::string &name)
@@ -47,6 +50,34 @@ InterfaceAdaptor *AdaptorBase::find_interface(const std::string &name)
 	return ii != _interfaces.end() ? ii->second : NULL;
 }
 
+/*	objects have a handful of interfaces, a walk through the (sorted) table
+	is cheaper than building a key for find()
+*/
+template <typename Table>
+static typename Table::mapped_type find_by_name(const Table &table, const char *name)
+{
+	if (!name)
+		return NULL;
+
+	typename Table::const_iterator ii;
+
+	for (ii = table.begin(); ii != table.end(); ++ii)
+	{
+		int cmp = std::strcmp(ii->first.c_str(), name);
+
+		if (cmp == 0)
+			return ii->second;
+		if (cmp > 0)
+			break;
+	}
+	return NULL;
+}
+
+InterfaceAdaptor *AdaptorBase::find_interface(const char *name)
+{
+	return find_by_name(_interfaces, name);
+}
+
 InterfaceAdaptor::InterfaceAdaptor(const std::string &name)
 : Interface(name)
 {
@@ -57,8 +88,11 @@ InterfaceAdaptor::InterfaceAdaptor(const std::string &name)
 
 Message InterfaceAdaptor::dispatch_method(const CallMessage &msg)
 {
-	const char *name = msg.member();
+	return _dispatch_method(msg.member(), msg);
+}
 
+Message InterfaceAdaptor::_dispatch_method(const char *name, const CallMessage &msg)
+{
 	MethodTable::iterator mi = _methods.find(name);
 	if (mi != _methods.end())
 	{
@@ -74,12 +108,22 @@ void InterfaceAdaptor::emit_signal(const SignalMessage &sig)
 {
 	SignalMessage &sig2 = const_cast<SignalMessage &>(sig);
 
-	if (sig2.interface() == NULL)
+	const char *interface = sig2.interface();
+
+	/*	signals always go out on this interface, those made from its
+		templates already have the name and are left as they are
+	*/
+	if (!interface || std::strcmp(interface, name().c_str()))
 		sig2.interface(name().c_str());
 
 	_emit_signal(sig2);
 }
 
+SignalMessage InterfaceAdaptor::create_signal(const SignalTemplate &tpl)
+{
+	return tpl.create(object()->path().c_str());
+}
+
 Variant *InterfaceAdaptor::get_property(const std::string &name)
 {
 	PropertyTable::iterator pti = _properties.find(name);
@@ -143,6 +187,11 @@ InterfaceProxy *ProxyBase::find_interface(const std::string &name)
 	return ii != _interfaces.end() ? ii->second : NULL;
 }
 
+InterfaceProxy *ProxyBase::find_interface(const char *name)
+{
+	return find_by_name(_interfaces, name);
+}
+
 InterfaceProxy::InterfaceProxy(const std::string &name)
 : Interface(name)
 {
@@ -153,21 +202,21 @@ InterfaceProxy::InterfaceProxy(const std::string &name)
 
 bool InterfaceProxy::dispatch_signal(const SignalMessage &msg)
 {
-	const char *name = msg.member();
+	_dispatch_signal(msg.member(), msg);
+
+	// Here we always return false because there might be
+	// another InterfaceProxy listening for the same signal.
+	// This way we instruct libdbus-1 to go on dispatching
+	// the signal.
+	return false;
+}
 
+void InterfaceProxy::_dispatch_signal(const char *name, const SignalMessage &msg)
+{
 	SignalTable::iterator si = _signals.find(name);
 	if (si != _signals.end())
 	{
 		si->second.call(msg);
-		// Here we always return false because there might be
-		// another InterfaceProxy listening for the same signal.
-		// This way we instruct libdbus-1 to go on dispatching
-		// the signal.
-		return false;
-	}
-	else	
-	{
-		return false;
 	}
 }
 
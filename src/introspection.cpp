@@ -114,7 +114,10 @@ Message IntrospectableAdaptor::Introspect(const CallMessage &call)
 		}
 	}
 
-	const ObjectPathList nodes = ObjectAdaptor::child_nodes_from_prefix(path + '/');
+	ObjectAdaptor *self = const_cast<ObjectAdaptor *>(object());
+
+	const ObjectPathList nodes = ObjectAdaptor::child_nodes_from_prefix(
+		self->conn(), path == "/" ? path : path + '/');
 	ObjectPathList::const_iterator oni;
 
 	for (oni = nodes.begin(); oni != nodes.end(); ++oni) 
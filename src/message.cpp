@@ -26,9 +26,11 @@
 #endif
 
 #include <dbus-c++/message.h>
+#include <dbus-c++/validate.h>
 
 #include <dbus/dbus.h>
 #include <cstdlib>
+#include <cstring>
 
 #include "internalerror.h"
 #include "message_p.h"
@@ -45,18 +47,19 @@ using namespace DBus;
 */
 
 MessageIter::MessageIter()
-: _pvt(new Private), _msg(NULL) {}
+: _msg(NULL) {}
 
 MessageIter::MessageIter(Message &msg)
-: _pvt(new Private), _msg(&msg) {}
+: _msg(&msg) {}
 
 MessageIter::MessageIter(const MessageIter &iter)
-: _pvt(new Private(*iter._pvt)), _msg(iter._msg) {}
+: _msg(iter._msg)
+{
+	*Private::iter(*this) = *Private::iter(iter);
+}
 
 MessageIter::~MessageIter()
 {
-	delete _pvt;
-	_pvt = NULL;
 	_msg = NULL;
 }
 
@@ -64,7 +67,7 @@ MessageIter &MessageIter::operator =(const MessageIter &iter)
 {
 	if (this != &iter)
 	{
-		*_pvt = *iter._pvt;
+		*Private::iter(*this) = *Private::iter(iter);
 		_msg = iter._msg;
 	}
 	return *this;
@@ -72,7 +75,7 @@ MessageIter &MessageIter::operator =(const MessageIter &iter)
 
 int MessageIter::type()
 {
-	return dbus_message_iter_get_arg_type(&_pvt->iter);
+	return dbus_message_iter_get_arg_type(Private::iter(*this));
 }
 
 bool MessageIter::at_end()
@@ -82,12 +85,12 @@ bool MessageIter::at_end()
 
 bool MessageIter::has_next()
 {
-	return dbus_message_iter_has_next(&_pvt->iter);
+	return dbus_message_iter_has_next(Private::iter(*this));
 }
 
 MessageIter &MessageIter::operator ++()
 {
-	dbus_message_iter_next(&_pvt->iter);
+	dbus_message_iter_next(Private::iter(*this));
 	return (*this);
 }
 
@@ -100,7 +103,7 @@ MessageIter MessageIter::operator ++(int)
 
 bool MessageIter::append_basic(int type_id, void *value)
 {
-	return dbus_message_iter_append_basic(&_pvt->iter, type_id, value);
+	return dbus_message_iter_append_basic(Private::iter(*this), type_id, value);
 }
 
 void MessageIter::get_basic(int type_id, void *ptr)
@@ -108,7 +111,7 @@ void MessageIter::get_basic(int type_id, void *ptr)
 	if (type() != type_id)
 		throw ErrorInvalidArgs("type mismatch");
 
-	dbus_message_iter_get_basic(&_pvt->iter, ptr);
+	dbus_message_iter_get_basic(Private::iter(*this), ptr);
 }
 
 bool MessageIter::append_byte(unsigned char b)
@@ -271,47 +274,47 @@ int MessageIter::get_fd()
 MessageIter MessageIter::recurse()
 {
 	MessageIter iter(msg());
-	dbus_message_iter_recurse(&_pvt->iter, &iter._pvt->iter);
+	dbus_message_iter_recurse(Private::iter(*this), Private::iter(iter));
 	return iter;
 }
 
 char *MessageIter::signature() const
 {
-	return dbus_message_iter_get_signature(&_pvt->iter);
+	return dbus_message_iter_get_signature(Private::iter(*this));
 }
 
 bool MessageIter::append_array(char type, const void *ptr, size_t length)
 {
-	return dbus_message_iter_append_fixed_array(&_pvt->iter, type, &ptr, length);
+	return dbus_message_iter_append_fixed_array(Private::iter(*this), type, &ptr, length);
 }
 
 int MessageIter::array_type()
 {
-	return dbus_message_iter_get_element_type(&_pvt->iter);
+	return dbus_message_iter_get_element_type(Private::iter(*this));
 }
 
 int MessageIter::get_array(void *ptr)
 {
 	int length;
-	dbus_message_iter_get_fixed_array(&_pvt->iter, ptr, &length);
+	dbus_message_iter_get_fixed_array(Private::iter(*this), ptr, &length);
 	return length;
 }
 
 bool MessageIter::is_array()
 {
-	return dbus_message_iter_get_arg_type(&_pvt->iter) == DBUS_TYPE_ARRAY;
+	return dbus_message_iter_get_arg_type(Private::iter(*this)) == DBUS_TYPE_ARRAY;
 }
 
 bool MessageIter::is_dict()
 {
-	return is_array() && dbus_message_iter_get_element_type(&_pvt->iter) == DBUS_TYPE_DICT_ENTRY;
+	return is_array() && dbus_message_iter_get_element_type(Private::iter(*this)) == DBUS_TYPE_DICT_ENTRY;
 }
 
 MessageIter MessageIter::new_array(const char *sig)
 {
 	MessageIter arr(msg());
 	dbus_message_iter_open_container(
-		&_pvt->iter, DBUS_TYPE_ARRAY, sig, &arr._pvt->iter
+		Private::iter(*this), DBUS_TYPE_ARRAY, sig, Private::iter(arr)
 	);
 	return arr;
 }
@@ -320,7 +323,7 @@ MessageIter MessageIter::new_variant(const char *sig)
 {
 	MessageIter var(msg());
 	dbus_message_iter_open_container(
-		&_pvt->iter, DBUS_TYPE_VARIANT, sig, &var._pvt->iter
+		Private::iter(*this), DBUS_TYPE_VARIANT, sig, Private::iter(var)
 	);
 	return var;
 }
@@ -329,7 +332,7 @@ MessageIter MessageIter::new_struct()
 {
 	MessageIter stu(msg());
 	dbus_message_iter_open_container(
-		&_pvt->iter, DBUS_TYPE_STRUCT, NULL, &stu._pvt->iter
+		Private::iter(*this), DBUS_TYPE_STRUCT, NULL, Private::iter(stu)
 	);
 	return stu;
 }
@@ -338,14 +341,14 @@ MessageIter MessageIter::new_dict_entry()
 {
 	MessageIter ent(msg());
 	dbus_message_iter_open_container(
-		&_pvt->iter, DBUS_TYPE_DICT_ENTRY, NULL, &ent._pvt->iter
+		Private::iter(*this), DBUS_TYPE_DICT_ENTRY, NULL, Private::iter(ent)
 	);
 	return ent;
 }
 
 void MessageIter::close_container(MessageIter &container)
 {
-	dbus_message_iter_close_container(&_pvt->iter, &container._pvt->iter);
+	dbus_message_iter_close_container(Private::iter(*this), Private::iter(container));
 }
 
 static bool is_basic_type(int typecode)
@@ -393,11 +396,11 @@ void MessageIter::copy_data(MessageIter &to)
 			MessageIter to_container (to.msg());
 			dbus_message_iter_open_container
 			(
-				&to._pvt->iter,
+				Private::iter(to),
 				from.type(),
 				from.type() == DBUS_TYPE_DICT_ENTRY ||
 				from.type() == DBUS_TYPE_STRUCT ? NULL : sig,
-				&to_container._pvt->iter
+				Private::iter(to_container)
 			);
 
 			from_container.copy_data(to_container);
@@ -528,14 +531,14 @@ Tag *Message::tag() const
 MessageIter Message::writer()
 {
 	MessageIter iter(*this);
-	dbus_message_iter_init_append(_pvt->msg, &iter._pvt->iter);
+	dbus_message_iter_init_append(_pvt->msg, MessageIter::Private::iter(iter));
 	return iter;
 }
 
 MessageIter Message::reader() const
 {
 	MessageIter iter(const_cast<Message &>(*this));
-	dbus_message_iter_init(_pvt->msg, &iter._pvt->iter);
+	dbus_message_iter_init(_pvt->msg, MessageIter::Private::iter(iter));
 	return iter;
 }
 
@@ -581,6 +584,11 @@ SignalMessage::SignalMessage(const char *path, const char *interface, const char
 	_pvt->msg = dbus_message_new_signal(path, interface, name);
 }
 
+SignalMessage::SignalMessage(Message::Private *p)
+: Message(p, false)
+{
+}
+
 bool SignalMessage::operator == (const SignalMessage &m) const
 {
 	return dbus_message_is_signal(_pvt->msg, m.interface(), m.member());
@@ -626,6 +634,80 @@ bool SignalMessage::path(const char *p)
 /*
 */
 
+SignalTemplate::SignalTemplate(const char *interface, const char *member)
+: _interface(interface), _member(member), _header(NULL)
+{
+}
+
+SignalTemplate::SignalTemplate(const char *path, const char *interface, const char *member)
+: _interface(interface), _member(member), _header(NULL)
+{
+	this->path(path);
+}
+
+SignalTemplate::SignalTemplate(const SignalTemplate &t)
+: _interface(t._interface), _member(t._member), _path(t._path), _header(NULL)
+{
+}
+
+SignalTemplate::~SignalTemplate()
+{
+	delete _header;
+}
+
+/*	threads building the header at the same time each make one, all but
+	the first to get it in drop theirs
+*/
+SignalMessage SignalTemplate::create(const char *default_path) const
+{
+	Message *header = __atomic_load_n(&_header, __ATOMIC_ACQUIRE);
+
+	if (!header)
+	{
+		DBusMessage *msg = dbus_message_new(DBUS_MESSAGE_TYPE_SIGNAL);
+
+		if (!msg) throw ErrorNoMemory("unable to create signal");
+
+		const char *p = _path.empty() ? default_path : _path.c_str();
+
+		if (!dbus_message_set_interface(msg, _interface)
+		 || !dbus_message_set_member(msg, _member)
+		 || (p && !dbus_message_set_path(msg, p)))
+		{
+			dbus_message_unref(msg);
+			throw ErrorInvalidArgs("invalid signal interface, member or path");
+		}
+
+		Message *built = new Message(new Message::Private(msg), false);
+
+		if (__atomic_compare_exchange_n(&_header, &header, built, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			header = built;
+		else
+			delete built;
+	}
+
+	DBusMessage *msg = dbus_message_copy(header->_pvt->msg);
+
+	if (!msg) throw ErrorNoMemory("unable to create signal");
+
+	return SignalMessage(new Message::Private(msg));
+}
+
+void SignalTemplate::path(const char *p)
+{
+	if (!validate_path(p, strlen(p)))
+		throw ErrorInvalidArgs("invalid signal path");
+
+	_path = p;
+
+	// built again with it next time
+	delete _header;
+	_header = NULL;
+}
+
+/*
+*/
+
 CallMessage::CallMessage()
 {
 	_pvt->msg = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_CALL);
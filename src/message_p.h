@@ -36,8 +36,16 @@
 
 namespace DBus {
 
-struct DXXAPILOCAL MessageIter::Private {
-	DBusMessageIter iter;
+struct DXXAPILOCAL MessageIter::Private
+{
+	typedef char storage_is_large_enough[
+		sizeof(DBusMessageIter) <= sizeof(((MessageIter *)0)->_iter) ? 1 : -1
+	];
+
+	static DBusMessageIter *iter(const MessageIter &it)
+	{
+		return reinterpret_cast<DBusMessageIter *>(const_cast<void **>(it._iter));
+	}
 };
 
 struct DXXAPILOCAL Message::Private
@@ -30,12 +30,15 @@
 #include "internalerror.h"
 
 #include <cstring>
+#include <list>
 #include <map>
+#include <vector>
 #include <dbus/dbus.h>
 
 #include "message_p.h"
 #include "server_p.h"
 #include "connection_p.h"
+#include "object_p.h"
 
 using namespace DBus;
 
@@ -91,34 +94,357 @@ DBusHandlerResult ObjectAdaptor::Private::message_function_stub(DBusConnection *
 	}
 }
 
-typedef std::map<Path, ObjectAdaptor *> ObjectAdaptorTable;
-static ObjectAdaptorTable _adaptor_table;
+/*	every tree, for the lookups which aren't given a connection
+*/
+static std::list<ObjectTree *> _trees;
+static pthread_mutex_t _trees_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ObjectTree::Node::~Node()
+{
+	std::map<std::string, Node *>::iterator ci;
+
+	for (ci = children.begin(); ci != children.end(); ++ci)
+		delete ci->second;
+}
+
+ObjectTree::ObjectTree()
+{
+	pthread_rwlock_init(&lock, NULL);
+
+	pthread_mutex_lock(&_trees_mutex);
+	_trees.push_back(this);
+	pthread_mutex_unlock(&_trees_mutex);
+}
+
+ObjectTree::~ObjectTree()
+{
+	pthread_mutex_lock(&_trees_mutex);
+	_trees.remove(this);
+	pthread_mutex_unlock(&_trees_mutex);
+
+	pthread_rwlock_destroy(&lock);
+}
+
+/*	the elements of a path, the root being "/" and nothing else
+*/
+static void split_path(const std::string &path, std::vector<std::string> &elements)
+{
+	size_t pos = 1;
+
+	while (pos < path.length())
+	{
+		size_t slash = path.find('/', pos);
+
+		if (slash == std::string::npos)
+			slash = path.length();
+
+		elements.push_back(path.substr(pos, slash - pos));
+		pos = slash + 1;
+	}
+}
+
+/*	the node for a path, made along with its parents if need be; called
+	with the lock held for writing
+*/
+ObjectTree::Node *ObjectTree::make(const std::string &path)
+{
+	std::vector<std::string> elements;
+	split_path(path, elements);
+
+	Node *n = &root;
+
+	for (size_t i = 0; i < elements.size(); ++i)
+	{
+		Node *&child = n->children[elements[i]];
+
+		if (!child)
+			child = new Node;
+
+		n = child;
+	}
+	return n;
+}
+
+/*	the node for a path if there's one, with the nodes leading to it
+*/
+ObjectTree::Node *ObjectTree::lookup(const std::string &path, std::vector<Node *> &trail, std::vector<std::string> &elements)
+{
+	split_path(path, elements);
+
+	Node *n = &root;
+
+	for (size_t i = 0; n && i < elements.size(); ++i)
+	{
+		trail.push_back(n);
+
+		std::map<std::string, Node *>::iterator ci = n->children.find(elements[i]);
+
+		n = ci != n->children.end() ? ci->second : NULL;
+	}
+	return n;
+}
+
+/*	drops a node left with nothing at or below it, then its parents
+*/
+void ObjectTree::prune(Node *n, std::vector<Node *> &trail, std::vector<std::string> &elements)
+{
+	for (size_t i = trail.size(); i > 0 && !n->object && !n->subtree && n->children.empty(); --i)
+	{
+		trail[i - 1]->children.erase(elements[i - 1]);
+		delete n;
+
+		n = trail[i - 1];
+	}
+}
+
+void ObjectTree::insert(const std::string &path, ObjectAdaptor *object)
+{
+	pthread_rwlock_wrlock(&lock);
+
+	make(path)->object = object;
+
+	pthread_rwlock_unlock(&lock);
+}
+
+void ObjectTree::remove(const std::string &path, ObjectAdaptor *object)
+{
+	std::vector<Node *> trail;
+	std::vector<std::string> elements;
+
+	pthread_rwlock_wrlock(&lock);
+
+	Node *n = lookup(path, trail, elements);
+
+	if (n && n->object == object)
+	{
+		n->object = NULL;
+		prune(n, trail, elements);
+	}
+
+	pthread_rwlock_unlock(&lock);
+}
+
+void ObjectTree::insert(const std::string &path, SubtreeAdaptor *subtree)
+{
+	pthread_rwlock_wrlock(&lock);
+
+	make(path)->subtree = subtree;
+
+	pthread_rwlock_unlock(&lock);
+}
+
+void ObjectTree::remove(const std::string &path, SubtreeAdaptor *subtree)
+{
+	std::vector<Node *> trail;
+	std::vector<std::string> elements;
+
+	pthread_rwlock_wrlock(&lock);
+
+	Node *n = lookup(path, trail, elements);
+
+	if (n && n->subtree == subtree)
+	{
+		n->subtree = NULL;
+		prune(n, trail, elements);
+	}
+
+	pthread_rwlock_unlock(&lock);
+}
+
+SubtreeAdaptor *ObjectTree::find_subtree(const std::string &path, std::string &suffix)
+{
+	std::vector<std::string> elements;
+	split_path(path, elements);
+
+	pthread_rwlock_rdlock(&lock);
+
+	Node *n = &root;
+	SubtreeAdaptor *subtree = root.subtree;
+	size_t depth = 0;
+
+	for (size_t i = 0; i < elements.size(); ++i)
+	{
+		std::map<std::string, Node *>::iterator ci = n->children.find(elements[i]);
+
+		if (ci == n->children.end())
+			break;
+
+		n = ci->second;
+
+		if (n->subtree)
+		{
+			subtree = n->subtree;
+			depth = i + 1;
+		}
+	}
+
+	pthread_rwlock_unlock(&lock);
+
+	suffix.clear();
+
+	for (size_t i = depth; subtree && i < elements.size(); ++i)
+	{
+		if (i > depth)
+			suffix += '/';
+
+		suffix += elements[i];
+	}
+	return subtree;
+}
+
+ObjectAdaptor *ObjectTree::find(const std::string &path)
+{
+	std::vector<std::string> elements;
+	split_path(path, elements);
+
+	pthread_rwlock_rdlock(&lock);
+
+	Node *n = &root;
+
+	for (size_t i = 0; n && i < elements.size(); ++i)
+	{
+		std::map<std::string, Node *>::iterator ci = n->children.find(elements[i]);
+
+		n = ci != n->children.end() ? ci->second : NULL;
+	}
+
+	ObjectAdaptor *object = n ? n->object : NULL;
+
+	pthread_rwlock_unlock(&lock);
+
+	return object;
+}
+
+/*	the node for the prefix up to its last '/', what's after that has to
+	be matched against the names of its children; NULL when there's none
+*/
+static ObjectTree::Node *prefix_node(ObjectTree::Node *root, const std::string &prefix, std::string &partial)
+{
+	if (prefix.empty() || prefix[0] != '/')
+		return NULL;
+
+	ObjectTree::Node *n = root;
+	size_t pos = 1;
+	size_t slash;
+
+	while ((slash = prefix.find('/', pos)) != std::string::npos)
+	{
+		std::map<std::string, ObjectTree::Node *>::iterator ci = n->children.find(prefix.substr(pos, slash - pos));
+
+		if (ci == n->children.end())
+			return NULL;
+
+		n = ci->second;
+		pos = slash + 1;
+	}
+	partial = prefix.substr(pos);
+
+	return n;
+}
+
+static void collect_objects(ObjectTree::Node *n, ObjectAdaptorPList &objects)
+{
+	if (n->object)
+		objects.push_back(n->object);
+
+	std::map<std::string, ObjectTree::Node *>::iterator ci;
+
+	for (ci = n->children.begin(); ci != n->children.end(); ++ci)
+		collect_objects(ci->second, objects);
+}
+
+void ObjectTree::find_prefix(const std::string &prefix, ObjectAdaptorPList &objects)
+{
+	pthread_rwlock_rdlock(&lock);
+
+	if (prefix.empty())
+	{
+		collect_objects(&root, objects);
+	}
+	else
+	{
+		std::string partial;
+		Node *n = prefix_node(&root, prefix, partial);
+
+		if (n)
+		{
+			// the only node whose own path starts with the prefix is the root
+			if (n == &root && partial.empty() && n->object)
+				objects.push_back(n->object);
+
+			std::map<std::string, Node *>::iterator ci = n->children.lower_bound(partial);
+
+			for (; ci != n->children.end() && !ci->first.compare(0, partial.length(), partial); ++ci)
+				collect_objects(ci->second, objects);
+		}
+	}
+
+	pthread_rwlock_unlock(&lock);
+}
+
+void ObjectTree::child_nodes(const std::string &prefix, ObjectPathList &names)
+{
+	pthread_rwlock_rdlock(&lock);
+
+	std::string partial;
+	Node *n = prefix_node(&root, prefix, partial);
+
+	if (n)
+	{
+		std::map<std::string, Node *>::iterator ci = n->children.lower_bound(partial);
+
+		for (; ci != n->children.end() && !ci->first.compare(0, partial.length(), partial); ++ci)
+		{
+			if (ci->first.length() > partial.length())
+				names.push_back(ci->first.substr(partial.length()));
+		}
+	}
+
+	pthread_rwlock_unlock(&lock);
+}
 
 ObjectAdaptor *ObjectAdaptor::from_path(const Path &path)
 {
-	ObjectAdaptorTable::iterator ati = _adaptor_table.find(path);
+	ObjectAdaptor *object = NULL;
+
+	pthread_mutex_lock(&_trees_mutex);
+
+	std::list<ObjectTree *>::iterator ti;
+
+	for (ti = _trees.begin(); ti != _trees.end() && !object; ++ti)
+		object = (*ti)->find(path);
+
+	pthread_mutex_unlock(&_trees_mutex);
 
-	if (ati != _adaptor_table.end())
-		return ati->second;
+	return object;
+}
 
-	return NULL;
+ObjectAdaptor *ObjectAdaptor::from_path(Connection &conn, const Path &path)
+{
+	return conn._pvt->objects.find(path);
 }
 
 ObjectAdaptorPList ObjectAdaptor::from_path_prefix(const std::string &prefix)
 {
 	ObjectAdaptorPList ali;
 
-	ObjectAdaptorTable::iterator ati = _adaptor_table.begin();
+	pthread_mutex_lock(&_trees_mutex);
 
-	size_t plen = prefix.length();
+	std::list<ObjectTree *>::iterator ti;
 
-	while (ati != _adaptor_table.end())
-	{
-		if (!strncmp(ati->second->path().c_str(), prefix.c_str(), plen))
-			ali.push_back(ati->second);
+	for (ti = _trees.begin(); ti != _trees.end(); ++ti)
+		(*ti)->find_prefix(prefix, ali);
 
-		++ati;
-	}
+	pthread_mutex_unlock(&_trees_mutex);
+
+	return ali;
+}
+
+ObjectAdaptorPList ObjectAdaptor::from_path_prefix(Connection &conn, const std::string &prefix)
+{
+	ObjectAdaptorPList ali;
+
+	conn._pvt->objects.find_prefix(prefix, ali);
 
 	return ali;
 }
@@ -127,35 +453,63 @@ ObjectPathList ObjectAdaptor::child_nodes_from_prefix(const std::string &prefix)
 {
 	ObjectPathList ali;
 
-	ObjectAdaptorTable::iterator ati = _adaptor_table.begin();
+	pthread_mutex_lock(&_trees_mutex);
+
+	std::list<ObjectTree *>::iterator ti;
+
+	for (ti = _trees.begin(); ti != _trees.end(); ++ti)
+		(*ti)->child_nodes(prefix, ali);
+
+	pthread_mutex_unlock(&_trees_mutex);
+
+	ali.sort();
+	ali.unique();
+
+	return ali;
+}
+
+/*	a node in a subtree has the children its enumerator tells about as
+	well, the prefix has to be a whole path followed by '/' for that
+*/
+ObjectPathList ObjectAdaptor::child_nodes_from_prefix(Connection &conn, const std::string &prefix)
+{
+	ObjectPathList ali;
+
+	conn._pvt->objects.child_nodes(prefix, ali);
 
 	size_t plen = prefix.length();
 
-	while (ati != _adaptor_table.end())
+	if (plen > 0 && prefix[plen - 1] == '/')
 	{
-	  if (!strncmp(ati->second->path().c_str(), prefix.c_str(), plen))
+		std::string suffix;
+		SubtreeAdaptor *subtree = conn._pvt->objects.find_subtree(
+			plen > 1 ? prefix.substr(0, plen - 1) : prefix, suffix);
+
+		if (subtree)
 		{
-				std::string p = ati->second->path().substr(plen);
-				p = p.substr(0,p.find('/'));
-				ali.push_back(p);
+			std::vector<std::string> children;
+
+			subtree->enumerate(suffix, children);
+
+			ali.insert(ali.end(), children.begin(), children.end());
+			ali.sort();
+			ali.unique();
 		}
-		++ati;
 	}
 
-	ali.sort();
-	ali.unique();
-
 	return ali;
 }
 
 ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path)
-: Object(conn, path, conn.unique_name()), _eflag(USE_EXCEPTIONS)
+: Object(conn, path, conn.unique_name()), _eflag(USE_EXCEPTIONS),
+  _domain(DISPATCHER_DOMAIN), _strand(NULL)
 {
 	register_obj();
 }
 
 ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime)
-: Object(conn, path, conn.unique_name()), _eflag(USE_EXCEPTIONS)
+: Object(conn, path, conn.unique_name()), _eflag(USE_EXCEPTIONS),
+  _domain(DISPATCHER_DOMAIN), _strand(NULL)
 {
 	if (rtime == REGISTER_NOW)
 		register_obj();
@@ -163,7 +517,26 @@ ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path, registration_ti
 
 ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime,
 				exceptions_flag eflag)
-: Object(conn, path, conn.unique_name()), _eflag(eflag)
+: Object(conn, path, conn.unique_name()), _eflag(eflag),
+  _domain(DISPATCHER_DOMAIN), _strand(NULL)
+{
+	if (rtime == REGISTER_NOW)
+		register_obj();
+}
+
+ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime,
+				exceptions_flag eflag, execution_domain domain)
+: Object(conn, path, conn.unique_name()), _eflag(eflag),
+  _domain(domain), _strand(domain == STRAND_DOMAIN ? this : NULL)
+{
+	if (rtime == REGISTER_NOW)
+		register_obj();
+}
+
+ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path, registration_time rtime,
+				exceptions_flag eflag, Strand &strand)
+: Object(conn, path, conn.unique_name()), _eflag(eflag),
+  _domain(STRAND_DOMAIN), _strand(&strand)
 {
 	if (rtime == REGISTER_NOW)
 		register_obj();
@@ -172,6 +545,11 @@ ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path, registration_ti
 ObjectAdaptor::~ObjectAdaptor()
 {
 	unregister_obj();
+
+	Dispatcher *d = conn()._pvt->dispatcher;
+
+	if (d)
+		d->forget_object(this);
 }
 
 void ObjectAdaptor::register_obj()
@@ -197,7 +575,7 @@ void ObjectAdaptor::register_obj()
  		throw ErrorNoMemory("unable to register object path");
 	}
 
-	_adaptor_table[path()] = this;
+	conn()._pvt->objects.insert(path(), this);
 }
 
 void ObjectAdaptor::unregister_obj()
@@ -205,7 +583,7 @@ void ObjectAdaptor::unregister_obj()
 	if (!is_registered())
 		return;
 
-	_adaptor_table.erase(path());
+	conn()._pvt->objects.remove(path(), this);
 
 	debug_log("unregistering local object %s", path().c_str());
 
@@ -228,14 +606,28 @@ void ObjectAdaptor::unregister_obj()
 
 bool ObjectAdaptor::is_registered()
 {
-	return _adaptor_table.find(path()) != _adaptor_table.end();
+	return conn()._pvt->objects.find(path()) == this;
 }
 
 void ObjectAdaptor::_emit_signal(SignalMessage &sig)
 {
-	sig.path(path().c_str());
+	const char *p = sig.path();
+
+	// signals made from a template already carry it
+	if (!p || path() != p)
+		sig.path(path().c_str());
+
+	post_message(sig);
+}
+
+void ObjectAdaptor::post_message(const Message &msg)
+{
+	Dispatcher *d = conn()._pvt->dispatcher;
 
-	conn().send(sig);
+	if (d)
+		d->post_message(conn(), msg);
+	else
+		conn().send(msg);
 }
 
 struct ReturnLaterError
@@ -250,48 +642,16 @@ bool ObjectAdaptor::handle_message(const Message &msg)
 		case DBUS_MESSAGE_TYPE_METHOD_CALL:
 		{
 			const CallMessage &cmsg = reinterpret_cast<const CallMessage &>(msg);
-			const char *member      = cmsg.member();
-			const char *interface   = cmsg.interface();
-
-			debug_log(" invoking method %s.%s", interface, member);
 
-			InterfaceAdaptor *ii = find_interface(interface);
-			if (ii)
-			{
-				if (_eflag == AVOID_EXCEPTIONS) {
-					Message ret = ii->dispatch_method(cmsg);
-					Tag *tag = ret.tag();
-					if (tag) {
-						_continuations[tag] =
-						    new Continuation(conn(), cmsg, tag);
-					} else {
-						conn().send(ret);
-					}
-					return true;
-				}
-				// TODO(jglasgow@google.com): make this code
-				// conditional based on compile time option to
-				// support exceptions.
-				try
-				{
-					Message ret = ii->dispatch_method(cmsg);
-					conn().send(ret);
-				}
-				catch(Error &e)
-				{
-					ErrorMessage em(cmsg, e.name(), e.message());
-					conn().send(em);
-				}
-				catch(ReturnLaterError &rle)
-				{
-					_continuations[rle.tag] = new Continuation(conn(), cmsg, rle.tag);
-				}
-				return true;
-			}
-			else
-			{
+			if (!find_interface(cmsg.interface()))
 				return false;
-			}
+
+			Dispatcher *d = conn()._pvt->dispatcher;
+
+			if (!d || !d->post_call(this, cmsg))
+				invoke(cmsg);
+
+			return true;
 		}
 		default:
 		{
@@ -300,39 +660,105 @@ bool ObjectAdaptor::handle_message(const Message &msg)
 	}
 }
 
+void ObjectAdaptor::invoke(const CallMessage &cmsg)
+{
+	const char *member      = cmsg.member();
+	const char *interface   = cmsg.interface();
+
+	debug_log(" invoking method %s.%s", interface, member);
+
+	InterfaceAdaptor *ii = find_interface(interface);
+
+	if (_eflag == AVOID_EXCEPTIONS) {
+		Message ret = ii->dispatch_method(cmsg);
+		Tag *tag = ret.tag();
+		if (tag) {
+			_mutex_c.lock();
+			_continuations[tag] =
+			    new Continuation(conn(), cmsg, tag);
+			_mutex_c.unlock();
+		} else {
+			post_message(ret);
+		}
+		return;
+	}
+	// TODO(jglasgow@google.com): make this code
+	// conditional based on compile time option to
+	// support exceptions.
+	try
+	{
+		Message ret = ii->dispatch_method(cmsg);
+		post_message(ret);
+	}
+	catch(Error &e)
+	{
+		ErrorMessage em(cmsg, e.name(), e.message());
+		post_message(em);
+	}
+	catch(ReturnLaterError &rle)
+	{
+		_mutex_c.lock();
+		_continuations[rle.tag] = new Continuation(conn(), cmsg, rle.tag);
+		_mutex_c.unlock();
+	}
+}
+
 void ObjectAdaptor::return_later(const Tag *tag)
 {
 	ReturnLaterError rle = { tag };
 	throw rle;
 }
 
+/*	the reply goes out from where the object's handlers run, so that it's
+	ordered with them
+*/
 void ObjectAdaptor::return_now(Continuation *ret)
 {
-	ret->_conn.send(ret->_return);
+	Dispatcher *d = conn()._pvt->dispatcher;
 
-	ContinuationMap::iterator di = _continuations.find(ret->_tag);
+	if (!d || !d->post_return(this, ret->_tag, ret->_return))
+		finish(ret->_tag, ret->_return);
+}
 
-	delete di->second;
+void ObjectAdaptor::return_error(Continuation *ret, const Error error)
+{
+	ErrorMessage em(ret->_call, error.name(), error.message());
 
-	_continuations.erase(di);
+	Dispatcher *d = conn()._pvt->dispatcher;
+
+	if (!d || !d->post_return(this, ret->_tag, em))
+		finish(ret->_tag, em);
 }
 
-void ObjectAdaptor::return_error(Continuation *ret, const Error error)
+void ObjectAdaptor::finish(const Tag *tag, const Message &reply)
 {
-	ret->_conn.send(ErrorMessage(ret->_call, error.name(), error.message()));
+	post_message(reply);
 
-	ContinuationMap::iterator di = _continuations.find(ret->_tag);
+	_mutex_c.lock();
 
-	delete di->second;
+	ContinuationMap::iterator di = _continuations.find(tag);
+
+	if (di != _continuations.end())
+	{
+		delete di->second;
+
+		_continuations.erase(di);
+	}
 
-	_continuations.erase(di);
+	_mutex_c.unlock();
 }
 
 ObjectAdaptor::Continuation *ObjectAdaptor::find_continuation(const Tag *tag)
 {
+	_mutex_c.lock();
+
 	ContinuationMap::iterator di = _continuations.find(tag);
 
-	return di != _continuations.end() ? di->second : NULL;
+	Continuation *ret = di != _continuations.end() ? di->second : NULL;
+
+	_mutex_c.unlock();
+
+	return ret;
 }
 
 ObjectAdaptor::Continuation::Continuation(Connection &conn, const CallMessage &call, const Tag *tag)
@@ -344,16 +770,150 @@ ObjectAdaptor::Continuation::Continuation(Connection &conn, const CallMessage &c
 /*
 */
 
+SignalRouter::SignalRouter()
+{
+	pthread_rwlock_init(&lock, NULL);
+}
+
+SignalRouter::~SignalRouter()
+{
+	pthread_rwlock_destroy(&lock);
+}
+
+/*	FNV-1a, over the path, a separator and the interface
+*/
+static unsigned long route_hash(const char *path, const char *interface)
+{
+	unsigned long h = 2166136261UL;
+
+	for (const char *c = path; *c; ++c)
+		h = (h ^ (unsigned char)*c) * 16777619UL;
+
+	h = (h ^ ' ') * 16777619UL;
+
+	for (const char *c = interface; *c; ++c)
+		h = (h ^ (unsigned char)*c) * 16777619UL;
+
+	return h;
+}
+
+void SignalRouter::subscribe(const std::string &path, const std::string &interface, ObjectProxy *proxy)
+{
+	Route r;
+	r.path = path;
+	r.interface = interface;
+	r.proxy = proxy;
+
+	pthread_rwlock_wrlock(&lock);
+
+	routes[route_hash(path.c_str(), interface.c_str())].push_back(r);
+
+	pthread_rwlock_unlock(&lock);
+}
+
+void SignalRouter::unsubscribe(const std::string &path, const std::string &interface, ObjectProxy *proxy)
+{
+	pthread_rwlock_wrlock(&lock);
+
+	RouteTable::iterator ri = routes.find(route_hash(path.c_str(), interface.c_str()));
+
+	if (ri != routes.end())
+	{
+		std::vector<Route> &bucket = ri->second;
+
+		for (size_t i = 0; i < bucket.size(); ++i)
+		{
+			if (bucket[i].proxy == proxy && bucket[i].path == path && bucket[i].interface == interface)
+			{
+				bucket.erase(bucket.begin() + i);
+				break;
+			}
+		}
+
+		if (bucket.empty())
+			routes.erase(ri);
+	}
+
+	pthread_rwlock_unlock(&lock);
+}
+
+/*	a proxy may go away while an earlier one handles the signal, or
+	before the first one is called once the lock is released
+*/
+bool SignalRouter::subscribed(unsigned long hash, ObjectProxy *proxy)
+{
+	bool found = false;
+
+	pthread_rwlock_rdlock(&lock);
+
+	RouteTable::iterator ri = routes.find(hash);
+
+	for (size_t i = 0; ri != routes.end() && !found && i < ri->second.size(); ++i)
+		found = ri->second[i].proxy == proxy;
+
+	pthread_rwlock_unlock(&lock);
+
+	return found;
+}
+
+void SignalRouter::route(const SignalMessage &sig)
+{
+	const char *path = sig.path();
+	const char *interface = sig.interface();
+
+	if (!path || !interface)
+		return;
+
+	unsigned long hash = route_hash(path, interface);
+
+	std::vector<ObjectProxy *> proxies;
+
+	pthread_rwlock_rdlock(&lock);
+
+	RouteTable::iterator ri = routes.find(hash);
+
+	if (ri != routes.end())
+	{
+		std::vector<Route> &bucket = ri->second;
+
+		for (size_t i = 0; i < bucket.size(); ++i)
+		{
+			if (!std::strcmp(bucket[i].path.c_str(), path)
+			 && !std::strcmp(bucket[i].interface.c_str(), interface))
+				proxies.push_back(bucket[i].proxy);
+		}
+	}
+
+	pthread_rwlock_unlock(&lock);
+
+	for (size_t i = 0; i < proxies.size(); ++i)
+	{
+		if (subscribed(hash, proxies[i]))
+			proxies[i]->handle_message(sig);
+	}
+}
+
+/*	signals go on to the other filters whoever handled them
+*/
+DBusHandlerResult SignalRouter::filter_stub(DBusConnection *, DBusMessage *dmsg, void *data)
+{
+	SignalRouter *router = static_cast<SignalRouter *>(data);
+
+	if (dbus_message_get_type(dmsg) == DBUS_MESSAGE_TYPE_SIGNAL)
+	{
+		Message msg(new Message::Private(dmsg));
+
+		router->route(reinterpret_cast<const SignalMessage &>(msg));
+	}
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
 ObjectProxy::ObjectProxy(Connection &conn, const Path &path, const char *service)
 : Object(conn, path, service)
 {
 	register_obj();
 }
 
-// TODO(ers@google.com): unregister_obj() makes a synchronous
-// dbus method call, which can result in a deadlock if the
-// ObjectProxy is deleted while in a callback from a signal
-// or a pending call reply.
 ObjectProxy::~ObjectProxy()
 {
 	cancel_pending_calls();
@@ -391,15 +951,13 @@ void ObjectProxy::register_obj()
 {
 	debug_log("registering remote object %s", path().c_str());
 
-	_filtered = new Callback<ObjectProxy, bool, const Message &>(this, &ObjectProxy::handle_message);
-
-	conn().add_filter(_filtered);
-
 	InterfaceProxyTable::const_iterator ii = _interfaces.begin();
 	while (ii != _interfaces.end())
 	{
+		conn()._pvt->signals.subscribe(path(), ii->first, this);
+
 		std::string im = "type='signal',interface='"+ii->first+"',path='"+path()+"'";
-		conn().add_match(im.c_str());
+		conn().add_match_async(im.c_str());
 		++ii;
 	}
 }
@@ -411,11 +969,12 @@ void ObjectProxy::unregister_obj()
 	InterfaceProxyTable::const_iterator ii = _interfaces.begin();
 	while (ii != _interfaces.end())
 	{
+		conn()._pvt->signals.unsubscribe(path(), ii->first, this);
+
 		std::string im = "type='signal',interface='"+ii->first+"',path='"+path()+"'";
-		conn().remove_match(im.c_str());
+		conn().remove_match_async(im.c_str());
 		++ii;
 	}
-	conn().remove_filter(_filtered);
 }
 
 bool ObjectProxy::is_registered()
@@ -469,8 +1028,6 @@ bool ObjectProxy::handle_message(const Message &msg)
 			const char *member	= smsg.member();
 			const char *objpath	= smsg.path();
 
-			if (objpath != path()) return false;
-
 			debug_log("filtered signal %s(in %s) from %s to object %s",
 				member, interface, msg.sender(), objpath);
 
@@ -0,0 +1,153 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_OBJECT_P_H
+#define __DBUSXX_OBJECT_P_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/object.h>
+#include <dbus-c++/subtree.h>
+
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include <dbus/dbus.h>
+
+namespace DBus {
+
+/*
+ * The local objects of a connection, by path: one node per path element,
+ * so that finding an object takes as many steps as its path has elements
+ * and listing the children of a node doesn't look at anything else.
+ * Nodes are only kept while there's an object (or a subtree, see
+ * SubtreeAdaptor) at or below them.
+ *
+ * Any number of threads may look objects up at once, changes wait for
+ * them to be done.
+ */
+
+struct DXXAPILOCAL ObjectTree
+{
+	struct Node
+	{
+		ObjectAdaptor *object;
+		SubtreeAdaptor *subtree;
+		std::map<std::string, Node *> children;
+
+		Node() : object(NULL), subtree(NULL)
+		{}
+
+		~Node();
+	};
+
+	ObjectTree();
+
+	~ObjectTree();
+
+	void insert(const std::string &path, ObjectAdaptor *);
+
+	void remove(const std::string &path, ObjectAdaptor *);
+
+	void insert(const std::string &path, SubtreeAdaptor *);
+
+	void remove(const std::string &path, SubtreeAdaptor *);
+
+	ObjectAdaptor *find(const std::string &path);
+
+	/*	the deepest subtree a path is in, and what's left of the path
+		below its prefix
+	*/
+	SubtreeAdaptor *find_subtree(const std::string &path, std::string &suffix);
+
+	/*	the same as ObjectAdaptor::from_path_prefix() and
+		ObjectAdaptor::child_nodes_from_prefix(), the prefix being
+		compared character by character with the paths
+	*/
+	void find_prefix(const std::string &prefix, ObjectAdaptorPList &);
+
+	void child_nodes(const std::string &prefix, ObjectPathList &);
+
+	pthread_rwlock_t lock;
+	Node root;
+
+private:
+
+	Node *make(const std::string &path);
+
+	Node *lookup(const std::string &path, std::vector<Node *> &trail, std::vector<std::string> &elements);
+
+	void prune(Node *, std::vector<Node *> &trail, std::vector<std::string> &elements);
+};
+
+/*
+ * The proxies of a connection by the path and interface of the signals
+ * they take: a single filter hands each signal to the proxies it's for,
+ * instead of every proxy filtering every message. The routes are kept in
+ * a hash table by a hash of path and interface, so that looking one up
+ * takes no string and no walk down a tree.
+ */
+
+struct DXXAPILOCAL SignalRouter
+{
+	struct Route
+	{
+		std::string path;
+		std::string interface;
+		ObjectProxy *proxy;
+	};
+
+	typedef std::unordered_map< unsigned long, std::vector<Route> > RouteTable;
+
+	SignalRouter();
+
+	~SignalRouter();
+
+	void subscribe(const std::string &path, const std::string &interface, ObjectProxy *);
+
+	void unsubscribe(const std::string &path, const std::string &interface, ObjectProxy *);
+
+	/*	hands a signal to its proxies, in the order they subscribed in
+	*/
+	void route(const SignalMessage &);
+
+	static DBusHandlerResult filter_stub(DBusConnection *, DBusMessage *, void *);
+
+	pthread_rwlock_t lock;
+	RouteTable routes;
+
+private:
+
+	bool subscribed(unsigned long hash, ObjectProxy *);
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_OBJECT_P_H
@@ -36,7 +36,7 @@
 using namespace DBus;
 
 Server::Private::Private(DBusServer *s)
-: server(s)
+: server(s), max_received_size(-1), max_received_unix_fds(-1)
 {
 }
 
@@ -50,6 +50,11 @@ void Server::Private::on_new_conn_cb(DBusServer *server, DBusConnection *conn, v
 
 	Connection nc (new Connection::Private(conn, s->_pvt.get()));
 
+	if (s->_pvt->max_received_size >= 0)
+		nc.set_max_received_size(s->_pvt->max_received_size);
+	if (s->_pvt->max_received_unix_fds >= 0)
+		nc.set_max_received_unix_fds(s->_pvt->max_received_unix_fds);
+
 	s->_pvt->connections.push_back(nc);
 
 	s->on_new_connection(nc);
@@ -127,3 +132,12 @@ void Server::disconnect()
 	dbus_server_disconnect(_pvt->server);
 }
 
+void Server::set_max_received_size(long size)
+{
+	_pvt->max_received_size = size;
+}
+
+void Server::set_max_received_unix_fds(long n)
+{
+	_pvt->max_received_unix_fds = n;
+}
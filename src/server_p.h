@@ -45,6 +45,9 @@ struct DXXAPILOCAL Server::Private
 
 	ConnectionList connections;
 
+	long max_received_size;
+	long max_received_unix_fds;
+
 	Private(DBusServer *);
 
 	~Private();
@@ -0,0 +1,314 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/debug.h>
+#include <dbus-c++/subtree.h>
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <sstream>
+
+#include <dbus/dbus.h>
+
+#include "internalerror.h"
+#include "message_p.h"
+#include "server_p.h"
+#include "connection_p.h"
+#include "object_p.h"
+
+using namespace DBus;
+
+static const char *introspectable_name = "org.freedesktop.DBus.Introspectable";
+
+struct SubtreeAdaptor::Private
+{
+	typedef std::list< std::pair<std::string, ObjectAdaptor *> > Cache;
+
+	size_t cache_size;
+
+	/*	most recently used first
+	*/
+	Cache cache;
+	std::map<std::string, Cache::iterator> cached;
+
+	ObjectAdaptor *get(const std::string &suffix);
+
+	void put(const std::string &suffix, ObjectAdaptor *);
+
+	void trim();
+
+	static void unregister_function_stub(DBusConnection *, void *);
+	static DBusHandlerResult message_function_stub(DBusConnection *, DBusMessage *, void *);
+};
+
+static DBusObjectPathVTable _vtable =
+{
+	SubtreeAdaptor::Private::unregister_function_stub,
+	SubtreeAdaptor::Private::message_function_stub,
+	NULL, NULL, NULL, NULL
+};
+
+void SubtreeAdaptor::Private::unregister_function_stub(DBusConnection *, void *)
+{
+}
+
+DBusHandlerResult SubtreeAdaptor::Private::message_function_stub(DBusConnection *, DBusMessage *dmsg, void *data)
+{
+	SubtreeAdaptor *s = static_cast<SubtreeAdaptor *>(data);
+
+	if (!s)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	Message msg(new Message::Private(dmsg));
+
+	debug_log("in subtree %s", s->prefix().c_str());
+	debug_log(" got message #%d from %s to %s",
+		msg.serial(),
+		msg.sender(),
+		msg.destination()
+	);
+
+	return s->handle_message(msg)
+		? DBUS_HANDLER_RESULT_HANDLED
+		: DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+ObjectAdaptor *SubtreeAdaptor::Private::get(const std::string &suffix)
+{
+	std::map<std::string, Cache::iterator>::iterator ci = cached.find(suffix);
+
+	if (ci == cached.end())
+		return NULL;
+
+	cache.splice(cache.begin(), cache, ci->second);
+
+	return ci->second->second;
+}
+
+void SubtreeAdaptor::Private::put(const std::string &suffix, ObjectAdaptor *object)
+{
+	cache.push_front(std::make_pair(suffix, object));
+	cached[suffix] = cache.begin();
+
+	trim();
+}
+
+/*	the least recently used objects go once the cache is full, but for
+	those with continuations pending; these are left over the size until
+	they're done, and go with a later call
+*/
+void SubtreeAdaptor::Private::trim()
+{
+	Cache::iterator ci = cache.end();
+
+	while (cache.size() > cache_size && ci != cache.begin())
+	{
+		--ci;
+
+		if (busy(ci->second))
+			continue;
+
+		cached.erase(ci->first);
+		delete ci->second;
+		ci = cache.erase(ci);
+	}
+}
+
+SubtreeAdaptor::SubtreeAdaptor(Connection &conn, const Path &prefix, size_t cache_size)
+: _conn(conn), _prefix(prefix), _pvt(new Private)
+{
+	_pvt->cache_size = cache_size;
+
+	debug_log("registering subtree %s", _prefix.c_str());
+
+	if (_conn._pvt->conn == NULL)
+	{
+		delete _pvt;
+		throw ErrorInvalidArgs("NULL connection");
+	}
+	else if (_prefix.c_str()[0] != '/')
+	{
+		delete _pvt;
+		std::string message = "Path must start with '/': " + _prefix;
+		throw ErrorInvalidArgs(message.c_str());
+	}
+
+	if (!dbus_connection_register_fallback(_conn._pvt->conn, _prefix.c_str(), &_vtable, this))
+	{
+		delete _pvt;
+		throw ErrorNoMemory("unable to register subtree");
+	}
+
+	_conn._pvt->objects.insert(_prefix, this);
+}
+
+SubtreeAdaptor::~SubtreeAdaptor()
+{
+	debug_log("unregistering subtree %s", _prefix.c_str());
+
+	_conn._pvt->objects.remove(_prefix, this);
+
+	dbus_connection_unregister_object_path(_conn._pvt->conn, _prefix.c_str());
+
+	forget_all();
+
+	delete _pvt;
+}
+
+void SubtreeAdaptor::enumerate(const std::string &, std::vector<std::string> &)
+{
+}
+
+void SubtreeAdaptor::forget(const std::string &suffix)
+{
+	std::map<std::string, Private::Cache::iterator>::iterator ci = _pvt->cached.find(suffix);
+
+	if (ci == _pvt->cached.end())
+		return;
+
+	delete ci->second->second;
+
+	_pvt->cache.erase(ci->second);
+	_pvt->cached.erase(ci);
+}
+
+bool SubtreeAdaptor::busy(ObjectAdaptor *object)
+{
+	object->_mutex_c.lock();
+	bool busy = !object->_continuations.empty();
+	object->_mutex_c.unlock();
+
+	return busy;
+}
+
+void SubtreeAdaptor::forget_all()
+{
+	Private::Cache::iterator i;
+
+	for (i = _pvt->cache.begin(); i != _pvt->cache.end(); ++i)
+		delete i->second;
+
+	_pvt->cache.clear();
+	_pvt->cached.clear();
+}
+
+/*	the object is run inline rather than posted to the dispatcher, unless
+	it's cached or has yet to answer it doesn't outlive the call
+*/
+bool SubtreeAdaptor::handle_message(const Message &msg)
+{
+	if (msg.type() != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return false;
+
+	const CallMessage &cmsg = reinterpret_cast<const CallMessage &>(msg);
+
+	// objects kept past the size while they were busy may be done by now
+	if (_pvt->cache.size() > _pvt->cache_size)
+		_pvt->trim();
+
+	const char *path = cmsg.path();
+	const char *interface = cmsg.interface();
+
+	if (!path)
+		return false;
+
+	std::string suffix;
+	size_t plen = _prefix.length();
+
+	if (plen == 1)
+		suffix = path + 1;
+	else if (std::strlen(path) > plen)
+		suffix = path + plen + 1;
+
+	ObjectAdaptor *o = _pvt->get(suffix);
+	bool cached = o != NULL;
+
+	if (!o)
+		o = resolve(suffix);
+
+	if (!o)
+	{
+		// there's nothing here, but there may be something below
+		if (interface && !std::strcmp(interface, introspectable_name)
+		 && !std::strcmp(cmsg.member(), "Introspect"))
+		{
+			_conn.send(introspect(cmsg));
+			return true;
+		}
+		return false;
+	}
+
+	bool handled = false;
+
+	if (interface && o->find_interface(interface))
+	{
+		o->invoke(cmsg);
+		handled = true;
+	}
+
+	if (cached)
+		return handled;
+
+	if (_pvt->cache_size > 0 || busy(o))
+		_pvt->put(suffix, o);
+	else
+		delete o;
+
+	return handled;
+}
+
+/*	a node with no object of its own, listing its children only
+*/
+Message SubtreeAdaptor::introspect(const CallMessage &call)
+{
+	debug_log("requested introspection data for subtree node %s", call.path());
+
+	std::ostringstream xml;
+
+	xml << DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE;
+
+	const std::string path = call.path();
+
+	xml << "<node name=\"" << path << "\">";
+
+	const ObjectPathList nodes = ObjectAdaptor::child_nodes_from_prefix(
+		_conn, path == "/" ? path : path + '/');
+	ObjectPathList::const_iterator oni;
+
+	for (oni = nodes.begin(); oni != nodes.end(); ++oni)
+	{
+		xml << "\n\t<node name=\"" << (*oni) << "\"/>";
+	}
+
+	xml << "\n</node>";
+
+	ReturnMessage reply(call);
+	MessageIter wi = reply.writer();
+	wi.append_string(xml.str().c_str());
+	return reply;
+}
@@ -0,0 +1,423 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/threadpool.h>
+#include <dbus-c++/object.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
+#include <dbus/dbus.h>
+
+#include "internalerror.h"
+#include "message_p.h"
+#include "server_p.h"
+#include "connection_p.h"
+
+using namespace DBus;
+
+/*	calls waiting to be run, one at a time, in order; a queue is either
+	idle, waiting for a worker in the ready list, or being run
+*/
+struct CallQueue
+{
+	struct Call
+	{
+		ObjectAdaptor *object;
+		Message msg;
+		const Tag *tag;	// a continuation's reply rather than a call
+
+		Call(ObjectAdaptor *o, const Message &m, const Tag *t) : object(o), msg(m), tag(t)
+		{}
+	};
+
+	typedef std::pair<const void *, std::string> Key;
+
+	std::deque<Call> calls;
+	bool busy;	// queued or running
+	bool keyed;	// found through its key, which has to be dropped with it
+	Key key;
+
+	CallQueue() : busy(false), keyed(false)
+	{}
+};
+
+struct DXXAPILOCAL ThreadPoolDispatcher::Private
+{
+	ThreadPoolDispatcher::ordering_type ordering;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool stopping;
+
+	std::map<CallQueue::Key, CallQueue *> queues;
+	std::deque<CallQueue *> ready;
+	std::vector<pthread_t> threads;
+
+	/*	how many workers are in a call of each object, waited for by
+		ThreadPoolDispatcher::forget_object()
+	*/
+	std::map<ObjectAdaptor *, int> running;
+	pthread_cond_t idle;
+
+	/*	replies and signals from the workers, to be sent by the
+		dispatching thread
+	*/
+	pthread_mutex_t out_mutex;
+	std::vector< std::pair<DBusConnection *, DBusMessage *> > out;
+
+	TaskSlot send_out;
+
+	void queue(ObjectAdaptor *, const char *peer, const Message &, const Tag *);
+
+	void run(CallQueue *);
+};
+
+/*	the pool a worker thread belongs to, and the object it's running a
+	call of
+*/
+static __thread ThreadPoolDispatcher::Private *current_pool = NULL;
+static __thread ObjectAdaptor *current_object = NULL;
+
+ThreadPoolDispatcher::ThreadPoolDispatcher(int threads, ordering_type ordering, backend_type backend)
+: BusDispatcher(backend), _pvt(new Private)
+{
+	_init_threading();
+
+	_pvt->ordering = ordering;
+	_pvt->stopping = false;
+
+	pthread_mutex_init(&_pvt->mutex, NULL);
+	pthread_cond_init(&_pvt->cond, NULL);
+	pthread_cond_init(&_pvt->idle, NULL);
+	pthread_mutex_init(&_pvt->out_mutex, NULL);
+
+	_pvt->send_out = new Callback<ThreadPoolDispatcher, void, BusDispatcher &>(this, &ThreadPoolDispatcher::replies_ready);
+
+	if (threads < 1)
+		threads = 1;
+
+	for (int i = 0; i < threads; ++i)
+	{
+		pthread_t th;
+
+		if (pthread_create(&th, NULL, &ThreadPoolDispatcher::worker, _pvt) != 0)
+			throw ErrorNoMemory("unable to start worker thread");
+
+		_pvt->threads.push_back(th);
+	}
+}
+
+/*	calls still queued are dropped, unanswered
+*/
+ThreadPoolDispatcher::~ThreadPoolDispatcher()
+{
+	pthread_mutex_lock(&_pvt->mutex);
+	_pvt->stopping = true;
+	pthread_cond_broadcast(&_pvt->cond);
+	pthread_mutex_unlock(&_pvt->mutex);
+
+	for (size_t i = 0; i < _pvt->threads.size(); ++i)
+		pthread_join(_pvt->threads[i], NULL);
+
+	std::map<CallQueue::Key, CallQueue *>::iterator qi;
+
+	for (qi = _pvt->queues.begin(); qi != _pvt->queues.end(); ++qi)
+		delete qi->second;
+
+	for (size_t i = 0; i < _pvt->ready.size(); ++i)
+	{
+		if (!_pvt->ready[i]->keyed) delete _pvt->ready[i];
+	}
+
+	for (size_t i = 0; i < _pvt->out.size(); ++i)
+	{
+		dbus_message_unref(_pvt->out[i].second);
+		dbus_connection_unref(_pvt->out[i].first);
+	}
+
+	pthread_mutex_destroy(&_pvt->out_mutex);
+	pthread_cond_destroy(&_pvt->idle);
+	pthread_cond_destroy(&_pvt->cond);
+	pthread_mutex_destroy(&_pvt->mutex);
+
+	delete _pvt;
+}
+
+bool ThreadPoolDispatcher::post_call(ObjectAdaptor *object, const CallMessage &call)
+{
+	// a wrapper of its own, the original goes away with the dispatching
+	// thread's stack
+	Message msg(new Message::Private(call._pvt->msg));
+
+	_pvt->queue(object, call.sender(), msg, NULL);
+
+	return true;
+}
+
+/*	the reply of a continuation is sent from the queue the object's calls
+	run on, so that it's ordered with them
+*/
+bool ThreadPoolDispatcher::post_return(ObjectAdaptor *object, const Tag *tag, const Message &reply)
+{
+	Message msg(new Message::Private(reply._pvt->msg));
+
+	_pvt->queue(object, reply.destination(), msg, tag);
+
+	return true;
+}
+
+/*	objects with an execution domain of their own pick the queue, the
+	others go by the pool's ordering
+*/
+void ThreadPoolDispatcher::Private::queue(ObjectAdaptor *object, const char *peer, const Message &msg, const Tag *tag)
+{
+	pthread_mutex_lock(&mutex);
+
+	CallQueue *q;
+
+	if (object->_domain == ObjectAdaptor::FREE_DOMAIN
+	 || (object->_domain == ObjectAdaptor::DISPATCHER_DOMAIN && ordering == ORDER_NONE))
+	{
+		q = new CallQueue;
+	}
+	else
+	{
+		CallQueue::Key key;
+
+		if (object->_domain == ObjectAdaptor::STRAND_DOMAIN)
+		{
+			key.first = object->_strand;
+		}
+		else if (ordering == ORDER_PER_SENDER)
+		{
+			key.first = object->conn()._pvt.get();
+			key.second = peer ? peer : "";
+		}
+		else
+		{
+			key.first = object;
+		}
+
+		CallQueue *&slot = queues[key];
+
+		if (!slot)
+		{
+			slot = new CallQueue;
+			slot->keyed = true;
+			slot->key = key;
+		}
+		q = slot;
+	}
+
+	q->calls.push_back(CallQueue::Call(object, msg, tag));
+
+	if (!q->busy)
+	{
+		q->busy = true;
+		ready.push_back(q);
+		pthread_cond_signal(&cond);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+static void drop_calls(CallQueue *q, ObjectAdaptor *object)
+{
+	std::deque<CallQueue::Call>::iterator ci = q->calls.begin();
+
+	while (ci != q->calls.end())
+	{
+		if (ci->object == object)
+			ci = q->calls.erase(ci);
+		else
+			++ci;
+	}
+}
+
+/*	the object's calls are taken out of every queue, queues left empty by
+	that go with them; an object deleted by one of its own handlers only
+	waits for the other workers
+*/
+void ThreadPoolDispatcher::forget_object(ObjectAdaptor *object)
+{
+	pthread_mutex_lock(&_pvt->mutex);
+
+	std::map<CallQueue::Key, CallQueue *>::iterator qi;
+
+	for (qi = _pvt->queues.begin(); qi != _pvt->queues.end(); ++qi)
+		drop_calls(qi->second, object);
+
+	std::deque<CallQueue *>::iterator ri = _pvt->ready.begin();
+
+	while (ri != _pvt->ready.end())
+	{
+		CallQueue *q = *ri;
+
+		drop_calls(q, object);
+
+		if (!q->calls.empty())
+		{
+			++ri;
+			continue;
+		}
+
+		if (q->keyed)
+			_pvt->queues.erase(q->key);
+
+		delete q;
+
+		ri = _pvt->ready.erase(ri);
+	}
+
+	int self = current_pool == _pvt && current_object == object ? 1 : 0;
+
+	std::map<ObjectAdaptor *, int>::iterator oi;
+
+	while ((oi = _pvt->running.find(object)) != _pvt->running.end() && oi->second > self)
+		pthread_cond_wait(&_pvt->idle, &_pvt->mutex);
+
+	pthread_mutex_unlock(&_pvt->mutex);
+}
+
+void ThreadPoolDispatcher::post_message(Connection &conn, const Message &msg)
+{
+	if (current_pool != _pvt)
+	{
+		conn.send(msg);
+		return;
+	}
+
+	pthread_mutex_lock(&_pvt->out_mutex);
+
+	bool wake = _pvt->out.empty();
+
+	_pvt->out.push_back(std::make_pair(
+		dbus_connection_ref(conn._pvt->conn),
+		dbus_message_ref(msg._pvt->msg)
+	));
+
+	pthread_mutex_unlock(&_pvt->out_mutex);
+
+	// the dispatching thread takes everything queued at once, one task
+	// is enough for that
+	if (wake)
+		post(_pvt->send_out);
+}
+
+void ThreadPoolDispatcher::replies_ready(BusDispatcher &)
+{
+	std::vector< std::pair<DBusConnection *, DBusMessage *> > out;
+
+	pthread_mutex_lock(&_pvt->out_mutex);
+	out.swap(_pvt->out);
+	pthread_mutex_unlock(&_pvt->out_mutex);
+
+	for (size_t i = 0; i < out.size(); ++i)
+	{
+		dbus_connection_send(out[i].first, out[i].second, NULL);
+
+		dbus_message_unref(out[i].second);
+		dbus_connection_unref(out[i].first);
+	}
+}
+
+/*	runs the oldest call of a queue, then puts the queue back at the end of
+	the ready list if there's more, so that a busy one doesn't keep a
+	worker to itself
+*/
+void ThreadPoolDispatcher::Private::run(CallQueue *q)
+{
+	CallQueue::Call call = q->calls.front();
+	q->calls.pop_front();
+
+	++running[call.object];
+	current_object = call.object;
+
+	pthread_mutex_unlock(&mutex);
+
+	if (call.tag)
+		call.object->finish(call.tag, call.msg);
+	else
+		call.object->invoke(reinterpret_cast<const CallMessage &>(call.msg));
+
+	pthread_mutex_lock(&mutex);
+
+	current_object = NULL;
+
+	std::map<ObjectAdaptor *, int>::iterator oi = running.find(call.object);
+
+	if (--oi->second == 0)
+	{
+		running.erase(oi);
+		pthread_cond_broadcast(&idle);
+	}
+
+	if (!q->calls.empty())
+	{
+		ready.push_back(q);
+		pthread_cond_signal(&cond);
+		return;
+	}
+
+	if (q->keyed)
+		queues.erase(q->key);
+
+	delete q;
+}
+
+void *ThreadPoolDispatcher::worker(void *data)
+{
+	Private *p = static_cast<Private *>(data);
+
+	current_pool = p;
+
+	pthread_mutex_lock(&p->mutex);
+
+	while (!p->stopping)
+	{
+		if (p->ready.empty())
+		{
+			pthread_cond_wait(&p->cond, &p->mutex);
+			continue;
+		}
+
+		CallQueue *q = p->ready.front();
+		p->ready.pop_front();
+
+		p->run(q);
+	}
+
+	pthread_mutex_unlock(&p->mutex);
+
+	return NULL;
+}
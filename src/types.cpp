@@ -29,77 +29,574 @@
 #include <dbus-c++/object.h>
 #include <dbus/dbus.h>
 #include <cstdlib>
+#include <cstring>
 #include <stdarg.h>
+#include <sched.h>
 
 #include "message_p.h"
 #include "internalerror.h"
 
 namespace DBus {
 
+/*	serialized compound values are turned back into messages by
+	prepending a minimal method return header to the stored body
+*/
+static void append_uint32(std::string &buf, dbus_uint32_t u)
+{
+	buf.append(reinterpret_cast<const char *>(&u), sizeof(u));
+}
+
+static void align(std::string &buf, size_t boundary)
+{
+	buf.resize((buf.size() + boundary - 1) & ~(boundary - 1), '\0');
+}
+
+static char byte_order()
+{
+	const dbus_uint32_t one = 1;
+
+	return *reinterpret_cast<const char *>(&one) ? DBUS_LITTLE_ENDIAN : DBUS_BIG_ENDIAN;
+}
+
+static DBusMessage *demarshal_body(const char *sig, const char *body, size_t body_len)
+{
+	std::string buf;
+
+	buf += byte_order();
+	buf += (char) DBUS_MESSAGE_TYPE_METHOD_RETURN;
+	buf += (char) 0;
+	buf += (char) DBUS_MAJOR_PROTOCOL_VERSION;
+	append_uint32(buf, body_len);
+	append_uint32(buf, 1);		// serial
+	append_uint32(buf, 0);		// header fields length, patched below
+
+	buf += (char) DBUS_HEADER_FIELD_REPLY_SERIAL;
+	buf += "\1u";
+	buf += '\0';
+	append_uint32(buf, 1);
+
+	align(buf, 8);
+	buf += (char) DBUS_HEADER_FIELD_SIGNATURE;
+	buf += "\1g";
+	buf += '\0';
+	buf += (char) strlen(sig);
+	buf += sig;
+	buf += '\0';
+
+	dbus_uint32_t fields_len = buf.size() - 16;
+	memcpy(&buf[12], &fields_len, sizeof(fields_len));
+
+	align(buf, 8);
+	buf.append(body, body_len);
+
+	InternalError e;
+	DBusMessage *msg = dbus_message_demarshal(buf.data(), buf.size(), e);
+
+	if (e) throw Error(e);
+
+	return msg;
+}
+
+static bool is_inline_type(int type)
+{
+	switch (type)
+	{
+		case DBUS_TYPE_BYTE:
+		case DBUS_TYPE_BOOLEAN:
+		case DBUS_TYPE_INT16:
+		case DBUS_TYPE_UINT16:
+		case DBUS_TYPE_INT32:
+		case DBUS_TYPE_UINT32:
+		case DBUS_TYPE_INT64:
+		case DBUS_TYPE_UINT64:
+		case DBUS_TYPE_DOUBLE:
+		case DBUS_TYPE_STRING:
+		case DBUS_TYPE_OBJECT_PATH:
+		case DBUS_TYPE_SIGNATURE:
+			return true;
+		default:
+			return false;
+	}
+}
+
 Variant::Variant()
-: _msg(CallMessage()) // dummy message used as temporary storage for variant data
+: _type(DBUS_TYPE_INVALID), _msg(NULL), _sync(SYNCED)
 {
 }
 
 Variant::Variant(MessageIter &it)
-: _msg(CallMessage())
+: _type(DBUS_TYPE_INVALID), _msg(NULL), _sync(SYNCED)
 {
 	MessageIter vi = it.recurse();
-	MessageIter mi = _msg.writer();
-	vi.copy_data(mi);
+
+	if (store_basic(vi))
+		return;
+
+	char *sig = vi.signature();
+
+	_data.assign(sig);
+	free(sig);
+
+	// file descriptors can only be kept in a message
+	if (_data.find(DBUS_TYPE_UNIX_FD) != std::string::npos)
+	{
+		CallMessage tmp;
+		MessageIter mi = tmp.writer();
+		vi.copy_data(mi);
+		store(tmp);
+		return;
+	}
+
+	BodyWriter body;
+	body.copy_data(vi);
+
+	_type = DBUS_TYPE_ARRAY;
+	_data += '\0';
+	_data.append(body.data(), body.size());
+}
+
+Variant::Variant(const Variant &v)
+: _type(DBUS_TYPE_INVALID), _msg(NULL), _sync(SYNCED)
+{
+	*this = v;
+}
+
+/*	takes over the value as it is, along with whatever was written to
+	_msg and not picked up yet, and leaves v empty; neither move throws,
+	so a growing std::vector moves its variants rather than copying them
+*/
+Variant::Variant(Variant &&v) noexcept
+: _type(v._type), _basic(v._basic), _data(std::move(v._data)), _msg(v._msg), _sync(v._sync)
+{
+	v._msg = NULL;
+	v.clear();
+}
+
+Variant::~Variant()
+{
+	delete _msg;
 }
 
 Variant &Variant::operator = (const Variant &v)
 {
 	if (&v != this)
 	{
+		v.sync();
+
+		delete _msg;
+		_msg = NULL;
+		_sync = SYNCED;
+
+		_type = v._type;
+		_basic = v._basic;
+		_data = v._data;
+
+		// values carrying file descriptors can only live in a message
+		if (v._type == DBUS_TYPE_UNIX_FD)
+			_msg = new Message(*v._msg);
+	}
+	return *this;
+}
+
+Variant &Variant::operator = (Variant &&v) noexcept
+{
+	if (&v != this)
+	{
+		delete _msg;
+
+		_type = v._type;
+		_basic = v._basic;
+		_data = std::move(v._data);
 		_msg = v._msg;
+		_sync = v._sync;
+
+		v._msg = NULL;
+		v.clear();
 	}
 	return *this;
 }
 
 void Variant::clear()
 {
-	CallMessage empty;
-	_msg = empty;
+	delete _msg;
+	_msg = NULL;
+	_sync = SYNCED;
+
+	_type = DBUS_TYPE_INVALID;
+	_data.clear();
 }
 
+/*	const variants may be read from several threads at once, the message
+	is built by whichever gets there first and the others drop theirs
+*/
+MessageIter Variant::reader() const
+{
+	sync();
+
+	Message *msg = __atomic_load_n(&_msg, __ATOMIC_ACQUIRE);
+
+	if (!msg)
+	{
+		Message *built = new Message(materialize());
+
+		if (__atomic_compare_exchange_n(&_msg, &msg, built, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			msg = built;
+		else
+			delete built;
+	}
+	return msg->reader();
+}
+
+MessageIter Variant::writer()
+{
+	sync();
+
+	if (!_msg)
+		_msg = new Message(materialize());
+
+	_sync = WRITTEN;
+
+	return _msg->writer();
+}
+
+/*	picks up whatever was written through writer() since the last call;
+	one reader does it while any other waits for the fields to be up to
+	date, the state is only SYNCED again once they are
+*/
+void Variant::sync() const
+{
+	int state = __atomic_load_n(&_sync, __ATOMIC_ACQUIRE);
+
+	while (state != SYNCED)
+	{
+		if (state == SYNCING)
+		{
+			sched_yield();
+			state = __atomic_load_n(&_sync, __ATOMIC_ACQUIRE);
+			continue;
+		}
+
+		if (!__atomic_compare_exchange_n(&_sync, &state, SYNCING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			continue;
+
+		try
+		{
+			const_cast<Variant *>(this)->store(*_msg);
+		}
+		catch (...)
+		{
+			__atomic_store_n(&_sync, WRITTEN, __ATOMIC_RELEASE);
+			throw;
+		}
+
+		__atomic_store_n(&_sync, SYNCED, __ATOMIC_RELEASE);
+		break;
+	}
+}
+
+bool Variant::store_basic(MessageIter &it)
+{
+	int type = it.type();
+
+	if (!is_inline_type(type) || it.has_next())
+		return false;
+
+	_type = type;
+	_data.clear();
+
+	switch (type)
+	{
+		case DBUS_TYPE_BYTE:        _basic.y = it.get_byte();   break;
+		case DBUS_TYPE_BOOLEAN:     _basic.b = it.get_bool();   break;
+		case DBUS_TYPE_INT16:       _basic.n = it.get_int16();  break;
+		case DBUS_TYPE_UINT16:      _basic.q = it.get_uint16(); break;
+		case DBUS_TYPE_INT32:       _basic.i = it.get_int32();  break;
+		case DBUS_TYPE_UINT32:      _basic.u = it.get_uint32(); break;
+		case DBUS_TYPE_INT64:       _basic.x = it.get_int64();  break;
+		case DBUS_TYPE_UINT64:      _basic.t = it.get_uint64(); break;
+		case DBUS_TYPE_DOUBLE:      _basic.d = it.get_double(); break;
+		case DBUS_TYPE_STRING:      _data = it.get_string();    break;
+		case DBUS_TYPE_OBJECT_PATH: _data = it.get_path();      break;
+		case DBUS_TYPE_SIGNATURE:   _data = it.get_signature(); break;
+	}
+	return true;
+}
+
+/*	replaces the stored value with the contents of msg
+*/
+void Variant::store(Message &msg)
+{
+	MessageIter it = msg.reader();
+
+	if (it.at_end())
+	{
+		_type = DBUS_TYPE_INVALID;
+		_data.clear();
+		return;
+	}
+
+	if (store_basic(it))
+		return;
+
+	const char *sig = dbus_message_get_signature(msg._pvt->msg);
+
+	if (strchr(sig, DBUS_TYPE_UNIX_FD))
+	{
+		// can't be serialized, keep the message itself
+		_type = DBUS_TYPE_UNIX_FD;
+		_data.clear();
+
+		if (_msg != &msg)
+		{
+			delete _msg;
+			_msg = new Message(msg);
+		}
+		return;
+	}
+
+	DBusMessage *copy = dbus_message_copy(msg._pvt->msg);
+	char *blob;
+	int blob_len;
+
+	if (!copy || !dbus_message_marshal(copy, &blob, &blob_len))
+	{
+		if (copy) dbus_message_unref(copy);
+		throw ErrorNoMemory("unable to serialize variant");
+	}
+	dbus_message_unref(copy);
+
+	dbus_uint32_t body_len, fields_len;
+	memcpy(&body_len, blob + 4, sizeof(body_len));
+	memcpy(&fields_len, blob + 12, sizeof(fields_len));
+
+	size_t body_start = (16 + fields_len + 7) & ~7;
+
+	_type = DBUS_TYPE_ARRAY;
+	_data.assign(sig);
+	_data += '\0';
+	_data.append(blob + body_start, body_len);
+
+	dbus_free(blob);
+}
+
+const char *Variant::body(const char *sig, size_t *len) const
+{
+	sync();
+
+	if (_type != DBUS_TYPE_ARRAY)
+		return NULL;
+
+	if (strcmp(sig, _data.c_str()))
+		throw ErrorInvalidArgs("type mismatch");
+
+	size_t sig_len = strlen(sig) + 1;
+
+	*len = _data.size() - sig_len;
+	return _data.data() + sig_len;
+}
+
+/*	builds a new message holding the stored value, for reader() and
+	writer() which hand out iterators on it
+*/
+Message Variant::materialize() const
+{
+	sync();
+
+	if (_type == DBUS_TYPE_UNIX_FD)
+		return *_msg;
+
+	if (_type == DBUS_TYPE_ARRAY)
+	{
+		const char *sig = _data.c_str();
+		size_t sig_len = strlen(sig) + 1;
+
+		DBusMessage *msg = demarshal_body(sig, _data.data() + sig_len, _data.size() - sig_len);
+
+		return Message(new Message::Private(msg), false);
+	}
+
+	CallMessage msg;
+	MessageIter wi = msg.writer();
+	append_to(wi);
+	return msg;
+}
+
+/*	appends a basic value straight from the inline storage
+*/
+template <typename W>
+void Variant::append_to(W &it) const
+{
+	switch (_type)
+	{
+		case DBUS_TYPE_BYTE:        it.append_byte(_basic.y);          break;
+		case DBUS_TYPE_BOOLEAN:     it.append_bool(_basic.b);          break;
+		case DBUS_TYPE_INT16:       it.append_int16(_basic.n);         break;
+		case DBUS_TYPE_UINT16:      it.append_uint16(_basic.q);        break;
+		case DBUS_TYPE_INT32:       it.append_int32(_basic.i);         break;
+		case DBUS_TYPE_UINT32:      it.append_uint32(_basic.u);        break;
+		case DBUS_TYPE_INT64:       it.append_int64(_basic.x);         break;
+		case DBUS_TYPE_UINT64:      it.append_uint64(_basic.t);        break;
+		case DBUS_TYPE_DOUBLE:      it.append_double(_basic.d);        break;
+		case DBUS_TYPE_STRING:      it.append_string(_data.c_str());    break;
+		case DBUS_TYPE_OBJECT_PATH: it.append_path(_data.c_str());      break;
+		case DBUS_TYPE_SIGNATURE:   it.append_signature(_data.c_str()); break;
+	}
+}
+
+#define DBUSXX_VARIANT_GET_INLINE(T, code, value) \
+	bool Variant::get_inline(T &v) const \
+	{ \
+		sync(); \
+		if (_type == DBUS_TYPE_ARRAY || _type == DBUS_TYPE_UNIX_FD) \
+			return false; \
+		if (_type != code) \
+			throw ErrorInvalidArgs("type mismatch"); \
+		v = value; \
+		return true; \
+	}
+
+DBUSXX_VARIANT_GET_INLINE(uint8_t,     DBUS_TYPE_BYTE,        _basic.y)
+DBUSXX_VARIANT_GET_INLINE(bool,        DBUS_TYPE_BOOLEAN,     _basic.b)
+DBUSXX_VARIANT_GET_INLINE(int16_t,     DBUS_TYPE_INT16,       _basic.n)
+DBUSXX_VARIANT_GET_INLINE(uint16_t,    DBUS_TYPE_UINT16,      _basic.q)
+DBUSXX_VARIANT_GET_INLINE(int32_t,     DBUS_TYPE_INT32,       _basic.i)
+DBUSXX_VARIANT_GET_INLINE(uint32_t,    DBUS_TYPE_UINT32,      _basic.u)
+DBUSXX_VARIANT_GET_INLINE(int64_t,     DBUS_TYPE_INT64,       _basic.x)
+DBUSXX_VARIANT_GET_INLINE(uint64_t,    DBUS_TYPE_UINT64,      _basic.t)
+DBUSXX_VARIANT_GET_INLINE(double,      DBUS_TYPE_DOUBLE,      _basic.d)
+DBUSXX_VARIANT_GET_INLINE(std::string, DBUS_TYPE_STRING,      _data)
+DBUSXX_VARIANT_GET_INLINE(Path,        DBUS_TYPE_OBJECT_PATH, _data)
+DBUSXX_VARIANT_GET_INLINE(Signature,   DBUS_TYPE_SIGNATURE,   _data)
+
+#undef DBUSXX_VARIANT_GET_INLINE
+
 const Signature Variant::signature() const
 {
-	char *sigbuf = reader().signature();
+	sync();
+
+	switch (_type)
+	{
+		case DBUS_TYPE_INVALID:
+			return Signature();
 
-	Signature signature = sigbuf;
+		case DBUS_TYPE_ARRAY:
+			return Signature(_data.c_str());
 
-	free(sigbuf);
+		case DBUS_TYPE_UNIX_FD:
+		{
+			char *sigbuf = _msg->reader().signature();
 
-	return signature;
+			Signature signature = sigbuf;
+
+			free(sigbuf);
+
+			return signature;
+		}
+
+		default:
+			return Signature(std::string(1, _type));
+	}
 }
 
 MessageIter &operator << (MessageIter &iter, const Variant &val)
 {
 	const Signature sig = val.signature();
 
-	MessageIter rit = val.reader();
 	MessageIter wit = iter.new_variant(sig.c_str());
 
-	rit.copy_data(wit);
+	if (is_inline_type(val._type))
+	{
+		val.append_to(wit);
+	}
+	else
+	{
+		Message msg = val.materialize();
+		MessageIter rit = msg.reader();
+
+		rit.copy_data(wit);
+	}
 
 	iter.close_container(wit);
 
 	return iter;
 }
 
-MessageIter &operator >> (MessageIter &iter, Variant &val)
+BodyWriter &operator << (BodyWriter &iter, const Variant &val)
 {
-	if (iter.type() != DBUS_TYPE_VARIANT)
-		throw ErrorInvalidArgs("variant type expected");
+	const Signature sig = val.signature();
+
+	BodyWriter wit = iter.new_variant(sig.c_str());
+
+	if (is_inline_type(val._type))
+	{
+		val.append_to(wit);
+	}
+	else if (val._type == DBUS_TYPE_ARRAY)
+	{
+		size_t len;
+		const char *data = val.body(sig.c_str(), &len);
+		BodyReader rit(data, len);
+
+		rit.copy_value(sig.c_str(), wit);
+	}
+	else
+	{
+		Message msg = val.materialize();
+		MessageIter rit = msg.reader();
+
+		wit.copy_data(rit);
+	}
+
+	iter.close_container(wit);
+
+	return iter;
+}
+
+BodyReader &operator >> (BodyReader &reader, Variant &val)
+{
+	const char *sig = reader.get_signature();
 
 	val.clear();
 
-	MessageIter vit = iter.recurse();
-	MessageIter mit = val.writer();
+	if (!is_inline_type(sig[0]) || sig[1])
+	{
+		BodyWriter body;
+		reader.copy_value(sig, body);
+
+		val._type = DBUS_TYPE_ARRAY;
+		val._data.assign(sig);
+		val._data += '\0';
+		val._data.append(body.data(), body.size());
+
+		return reader;
+	}
+
+	val._type = sig[0];
+
+	switch (val._type)
+	{
+		case DBUS_TYPE_BYTE:        val._basic.y = reader.get_byte();   break;
+		case DBUS_TYPE_BOOLEAN:     val._basic.b = reader.get_bool();   break;
+		case DBUS_TYPE_INT16:       val._basic.n = reader.get_int16();  break;
+		case DBUS_TYPE_UINT16:      val._basic.q = reader.get_uint16(); break;
+		case DBUS_TYPE_INT32:       val._basic.i = reader.get_int32();  break;
+		case DBUS_TYPE_UINT32:      val._basic.u = reader.get_uint32(); break;
+		case DBUS_TYPE_INT64:       val._basic.x = reader.get_int64();  break;
+		case DBUS_TYPE_UINT64:      val._basic.t = reader.get_uint64(); break;
+		case DBUS_TYPE_DOUBLE:      val._basic.d = reader.get_double(); break;
+		case DBUS_TYPE_STRING:      val._data = reader.get_string();    break;
+		case DBUS_TYPE_OBJECT_PATH: val._data = reader.get_path();      break;
+		case DBUS_TYPE_SIGNATURE:   val._data = reader.get_signature(); break;
+	}
+	return reader;
+}
+
+MessageIter &operator >> (MessageIter &iter, Variant &val)
+{
+	if (iter.type() != DBUS_TYPE_VARIANT)
+		throw ErrorInvalidArgs("variant type expected");
 
-	vit.copy_data(mit);
+	val = Variant(iter);
 
 	return ++iter;
 }
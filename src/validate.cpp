@@ -0,0 +1,382 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *  Copyright (C) 2005-2007  Paolo Durante <shackan@gmail.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/validate.h>
+#include <dbus/dbus.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DBUSXX_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace DBus;
+
+typedef const unsigned char *(*ScanFunction)(const unsigned char *, const unsigned char *);
+
+/*
+ *   The vector code only finds the first byte needing a closer look (the
+ *   first non ASCII or NUL byte for strings, the first byte which isn't a
+ *   plain path character or which doubles a slash for paths); everything
+ *   from there on is checked one character at a time
+ */
+
+static const unsigned char *ascii_scalar(const unsigned char *p, const unsigned char *end)
+{
+	while (p < end && *p && *p < 0x80) ++p;
+	return p;
+}
+
+static bool is_path_char(unsigned char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/*	p is never at the start of the path, so p[-1] can always be read
+*/
+static const unsigned char *path_scalar(const unsigned char *p, const unsigned char *end)
+{
+	for (; p < end; ++p)
+	{
+		if (!is_path_char(*p) && (*p != '/' || p[-1] == '/'))
+			break;
+	}
+	return p;
+}
+
+#ifdef DBUSXX_X86_SIMD
+
+__attribute__((target("sse2")))
+static const unsigned char *ascii_sse2(const unsigned char *p, const unsigned char *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		int bits = _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+
+		if (bits) return p + __builtin_ctz(bits);
+	}
+	return ascii_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *ascii_avx2(const unsigned char *p, const unsigned char *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		unsigned bits = _mm256_movemask_epi8(v) | _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+
+		if (bits) return p + __builtin_ctz(bits);
+	}
+	return ascii_sse2(p, end);
+}
+
+/*	bytes are compared as signed, so anything above 0x7f fails every range
+*/
+__attribute__((target("sse2")))
+static inline __m128i in_range_sse2(__m128i v, char lo, char hi)
+{
+	return _mm_and_si128(
+		_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+		_mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1))
+	);
+}
+
+__attribute__((target("sse2")))
+static const unsigned char *path_sse2(const unsigned char *p, const unsigned char *end)
+{
+	const __m128i slash = _mm_set1_epi8('/');
+
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p - 1));
+
+		__m128i is_slash = _mm_cmpeq_epi8(v, slash);
+		__m128i ok = _mm_or_si128(
+			_mm_or_si128(
+				in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+				in_range_sse2(v, '0', '9')
+			),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('_'))
+		);
+		ok = _mm_or_si128(ok, _mm_andnot_si128(_mm_cmpeq_epi8(prev, slash), is_slash));
+
+		int bad = ~_mm_movemask_epi8(ok) & 0xffff;
+
+		if (bad) return p + __builtin_ctz(bad);
+	}
+	return path_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(__m256i v, char lo, char hi)
+{
+	return _mm256_and_si256(
+		_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v)
+	);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *path_avx2(const unsigned char *p, const unsigned char *end)
+{
+	const __m256i slash = _mm256_set1_epi8('/');
+
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		__m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p - 1));
+
+		__m256i is_slash = _mm256_cmpeq_epi8(v, slash);
+		__m256i ok = _mm256_or_si256(
+			_mm256_or_si256(
+				in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'),
+				in_range_avx2(v, '0', '9')
+			),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))
+		);
+		ok = _mm256_or_si256(ok, _mm256_andnot_si256(_mm256_cmpeq_epi8(prev, slash), is_slash));
+
+		unsigned bad = ~(unsigned) _mm256_movemask_epi8(ok);
+
+		if (bad) return p + __builtin_ctz(bad);
+	}
+	return path_sse2(p, end);
+}
+
+#endif//DBUSXX_X86_SIMD
+
+struct Scanners
+{
+	ScanFunction ascii;
+	ScanFunction path;
+};
+
+static Scanners pick_scanners()
+{
+	Scanners s = { ascii_scalar, path_scalar };
+
+#ifdef DBUSXX_X86_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		s.ascii = ascii_avx2;
+		s.path = path_avx2;
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		s.ascii = ascii_sse2;
+		s.path = path_sse2;
+	}
+#endif
+	return s;
+}
+
+static const Scanners &scanners()
+{
+	static const Scanners s = pick_scanners();
+	return s;
+}
+
+/*	checks the character starting at p, which isn't plain ASCII, and moves
+	past it; overlong forms, surrogates and values beyond U+10FFFF are refused
+*/
+static bool utf8_char(const unsigned char *&p, const unsigned char *end)
+{
+	unsigned char c = *p;
+	size_t n;
+	dbus_uint32_t cp, min;
+
+	if (!c)
+		return false;
+	if (c < 0x80)
+	{
+		++p;
+		return true;
+	}
+
+	if ((c & 0xe0) == 0xc0)      { n = 1; cp = c & 0x1f; min = 0x80; }
+	else if ((c & 0xf0) == 0xe0) { n = 2; cp = c & 0x0f; min = 0x800; }
+	else if ((c & 0xf8) == 0xf0) { n = 3; cp = c & 0x07; min = 0x10000; }
+	else return false;
+
+	if ((size_t)(end - p) <= n)
+		return false;
+
+	for (size_t i = 1; i <= n; ++i)
+	{
+		if ((p[i] & 0xc0) != 0x80)
+			return false;
+
+		cp = (cp << 6) | (p[i] & 0x3f);
+	}
+
+	if (cp < min || cp > 0x10ffff || (cp & 0xfffff800) == 0xd800)
+		return false;
+
+	p += n + 1;
+	return true;
+}
+
+bool DBus::validate_utf8(const char *chars, size_t len)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(chars);
+	const unsigned char *end = p + len;
+	ScanFunction ascii = scanners().ascii;
+
+	while ((p = ascii(p, end)) < end)
+	{
+		// stay on the slow path through runs of multibyte characters
+		do
+		{
+			if (!utf8_char(p, end))
+				return false;
+		}
+		while (p < end && *p >= 0x80);
+	}
+	return true;
+}
+
+bool DBus::validate_path(const char *chars, size_t len)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(chars);
+
+	if (!len || p[0] != '/')
+		return false;
+
+	if (len == 1)
+		return true;
+
+	if (p[len - 1] == '/')
+		return false;
+
+	return scanners().path(p + 1, p + len) == p + len;
+}
+
+static bool is_basic_type(char type)
+{
+	switch (type)
+	{
+		case DBUS_TYPE_BYTE:
+		case DBUS_TYPE_BOOLEAN:
+		case DBUS_TYPE_INT16:
+		case DBUS_TYPE_UINT16:
+		case DBUS_TYPE_INT32:
+		case DBUS_TYPE_UINT32:
+		case DBUS_TYPE_INT64:
+		case DBUS_TYPE_UINT64:
+		case DBUS_TYPE_DOUBLE:
+		case DBUS_TYPE_STRING:
+		case DBUS_TYPE_OBJECT_PATH:
+		case DBUS_TYPE_SIGNATURE:
+		case DBUS_TYPE_UNIX_FD:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*	one complete type, arrays and structs nest at most 32 levels each
+*/
+static bool signature_type(const char *&p, const char *end, int arrays, int structs)
+{
+	if (p == end)
+		return false;
+
+	char type = *p++;
+
+	if (is_basic_type(type) || type == DBUS_TYPE_VARIANT)
+		return true;
+
+	switch (type)
+	{
+		case DBUS_TYPE_ARRAY:
+		{
+			if (++arrays > DBUS_MAXIMUM_TYPE_RECURSION_DEPTH)
+				return false;
+
+			// dict entries may only appear as array elements
+			if (p != end && *p == DBUS_DICT_ENTRY_BEGIN_CHAR)
+			{
+				if (++structs > DBUS_MAXIMUM_TYPE_RECURSION_DEPTH)
+					return false;
+
+				++p;
+				if (p == end || !is_basic_type(*p))
+					return false;
+
+				++p;
+				if (!signature_type(p, end, arrays, structs))
+					return false;
+
+				return p != end && *p++ == DBUS_DICT_ENTRY_END_CHAR;
+			}
+			return signature_type(p, end, arrays, structs);
+		}
+
+		case DBUS_STRUCT_BEGIN_CHAR:
+		{
+			if (++structs > DBUS_MAXIMUM_TYPE_RECURSION_DEPTH)
+				return false;
+
+			// no empty structs
+			do
+			{
+				if (!signature_type(p, end, arrays, structs))
+					return false;
+			}
+			while (p != end && *p != DBUS_STRUCT_END_CHAR);
+
+			return p != end && *p++ == DBUS_STRUCT_END_CHAR;
+		}
+
+		default:
+			return false;
+	}
+}
+
+bool DBus::validate_signature(const char *chars, size_t len)
+{
+	if (len > DBUS_MAXIMUM_SIGNATURE_LENGTH)
+		return false;
+
+	const char *p = chars;
+	const char *end = chars + len;
+
+	while (p != end)
+	{
+		if (!signature_type(p, end, 0, 0))
+			return false;
+	}
+	return true;
+}
@@ -5,7 +5,8 @@
 #define __dbusxx_ef__{{FILE_STRING}}__ADAPTOR_MARSHALL_H
 
 #include <dbus-c++/dbus.h>
-#include <cassert>{{BI_NEWLINE}}
+#include <cassert>
+#include <cstring>{{BI_NEWLINE}}
 
 {{#FOR_EACH_INTERFACE}}
 {{#FOR_EACH_NAMESPACE}}
@@ -19,6 +20,9 @@ public:
 
     {{CLASS_NAME}}_adaptor()
     : ::DBus::InterfaceAdaptor("{{INTERFACE_NAME}}")
+{{#FOR_EACH_SIGNAL}}
+    , _{{SIGNAL_NAME}}_signal("{{INTERFACE_NAME}}", "{{SIGNAL_NAME}}")
+{{/FOR_EACH_SIGNAL}}
     {
 {{#FOR_EACH_PROPERTY}}
         bind_property({{PROP_NAME}}, "{{PROP_SIG}}", {{PROP_READABLE}}, {{PROP_WRITEABLE}});
@@ -120,7 +124,7 @@ public:
 {{#FOR_EACH_SIGNAL}}
     void {{SIGNAL_NAME}}({{#CONST_SIGNAL_ARG_LIST}}{{SIGNAL_ARG_DECL}}{{#CONST_SIGNAL_ARG_LIST_separator}}, {{/CONST_SIGNAL_ARG_LIST_separator}}{{/CONST_SIGNAL_ARG_LIST}})
     {
-        ::DBus::SignalMessage __sig("{{SIGNAL_NAME}}");
+        ::DBus::SignalMessage __sig = create_signal(_{{SIGNAL_NAME}}_signal);
 {{#SIGNAL_ARGS_SECTION}}
         ::DBus::MessageIter __wi = __sig.writer();
 {{#FOR_EACH_SIGNAL_ARG}}
@@ -163,6 +167,21 @@ protected:
 
 
 private:
+    /* signal headers, built by the first emission */
+{{#FOR_EACH_SIGNAL}}
+    ::DBus::SignalTemplate _{{SIGNAL_NAME}}_signal;
+{{/FOR_EACH_SIGNAL}}
+
+{{#METHOD_SWITCH_SECTION}}
+    /* finds the handler of a call without going through the method table
+     */
+    ::DBus::Message _dispatch_method(const char *__member, const ::DBus::CallMessage &__call)
+    {
+{{METHOD_SWITCH}}
+        return ::DBus::InterfaceAdaptor::_dispatch_method(__member, __call);
+    }
+
+{{/METHOD_SWITCH_SECTION}}
     /* unmarshallers (to unpack the DBus message before calling the actual
      * interface method)
      */
@@ -170,7 +189,14 @@ private:
     ::DBus::Message _{{METHOD_NAME}}_stub(const ::DBus::CallMessage &__call)
     {
 {{#METHOD_IN_ARGS_SECTION}}
+{{#METHOD_IN_PLAN_SECTION}}
+        static const ::DBus::SignaturePlan __plan("{{METHOD_IN_SIG}}");
+        /* borrowed arguments point into __ri, they go away with this stub */
+        ::DBus::BodyReader __ri(__call, __plan);
+{{/METHOD_IN_PLAN_SECTION}}
+{{#METHOD_IN_ITER_SECTION}}
         ::DBus::MessageIter __ri = __call.reader();
+{{/METHOD_IN_ITER_SECTION}}
 {{#FOR_EACH_METHOD_IN_ARG}}
         {{METHOD_IN_ARG_TYPE}} {{METHOD_IN_ARG_NAME}}; __ri >> {{METHOD_IN_ARG_NAME}};
 {{/FOR_EACH_METHOD_IN_ARG}}
@@ -25,6 +25,7 @@
 #include <fstream>
 #include <cstdlib>
 #include <ctemplate/template.h>
+#include <dbus/dbus.h>		// for DBUS_TYPE_*
 
 #include "generator_utils.h"
 #include "generate_stubs.h"
@@ -36,6 +37,27 @@ using namespace DBus;
 /*! Generate RPC stub code for an XML introspection
 */
 
+/*! Annotation asking for 'in' arguments to be passed to adaptors as
+ * borrowed views (StringRef, PathRef, ArrayRef) into the call message;
+ * it can be set on a whole <method> or on single <arg>s. With the plan
+ * annotation below the views point into the stub's BodyReader instead,
+ * and are gone once the handler returns, even if it answers later.
+ */
+static const char *borrow_annotation = "org.freedesktop.DBus.CPlusPlus.Borrow";
+
+/*! Annotation asking for a method's 'in' arguments to be read by an
+ * adaptor with a BodyReader, rather than a MessageIter; it copies the
+ * message first, so it's only worth it for calls carrying many values.
+ */
+static const char *plan_annotation = "org.freedesktop.DBus.CPlusPlus.Plan";
+
+static bool has_annotation(Xml::Node &node, const char *name)
+{
+	Xml::Nodes annotations = node["annotation"].select("name", name);
+
+	return !annotations.empty() && annotations.front()->get("value") == "true";
+}
+
 /*! Generate the code for the methods in the introspection file.
  * Each call to this function can generate code for either the
  * synchronous, blocking versions of the method invocations, or
@@ -51,6 +73,7 @@ void generate_methods(TemplateDictionary *dict, Xml::Nodes &methods)
 		Xml::Nodes args_in = args.select("direction", "in");
 		Xml::Nodes args_out = args.select("direction", "out");
 		string name(method.get("name"));
+		bool borrow_all = has_annotation(method, borrow_annotation);
 
 		TemplateDictionary *sync_method_dict =
 				dict->AddSectionDictionary("FOR_EACH_METHOD");
@@ -74,6 +97,23 @@ void generate_methods(TemplateDictionary *dict, Xml::Nodes &methods)
 		{
 			for (m = 0; m < 2; m++)
 				method_dicts[m]->ShowSection("METHOD_IN_ARGS_SECTION");
+
+			// adaptors may parse the arguments with a plan compiled once
+			// per method, unless they carry unix fds
+			string in_sig;
+			for (Xml::Nodes::iterator ai = args_in.begin(); ai != args_in.end(); ++ai)
+				in_sig += (*ai)->get("type");
+
+			if (has_annotation(method, plan_annotation)
+			 && in_sig.find(DBUS_TYPE_UNIX_FD) == string::npos)
+			{
+				sync_method_dict->SetValue("METHOD_IN_SIG", in_sig);
+				sync_method_dict->ShowSection("METHOD_IN_PLAN_SECTION");
+			}
+			else
+			{
+				sync_method_dict->ShowSection("METHOD_IN_ITER_SECTION");
+			}
 		}
 
 		unsigned int i = 0;
@@ -89,6 +129,15 @@ void generate_methods(TemplateDictionary *dict, Xml::Nodes &methods)
 			arg_name = arg_name.empty() ?
 					("argin" + i) : legalize(arg_name);
 			arg_decl += arg_name;
+
+			// proxies always take owned values, only adaptors may borrow
+			string adaptor_arg_type = arg_type;
+			string adaptor_arg_decl = arg_decl;
+			if (borrow_all || has_annotation(arg, borrow_annotation))
+			{
+				adaptor_arg_type = signature_to_borrowed_type(arg.get("type"));
+				adaptor_arg_decl = "const " + adaptor_arg_type + "& " + arg_name;
+			}
 			for (m = 0; m < 2; m++)
 			{
 				arg_dict = method_dicts[m]->AddSectionDictionary("METHOD_ARG_LIST");
@@ -98,7 +147,7 @@ void generate_methods(TemplateDictionary *dict, Xml::Nodes &methods)
 
 				TemplateDictionary *inarg_dict = method_dicts[m]->AddSectionDictionary("FOR_EACH_METHOD_IN_ARG");
 				inarg_dict->SetValue("METHOD_IN_ARG_NAME", arg_name);
-				inarg_dict->SetValue("METHOD_IN_ARG_TYPE", arg_type);
+				inarg_dict->SetValue("METHOD_IN_ARG_TYPE", adaptor_arg_type);
 
 				all_args_dict = method_dicts[m]->AddSectionDictionary("FOR_EACH_METHOD_ARG");
 				all_args_dict->SetValue("METHOD_ARG_NAME", arg_name);
@@ -106,7 +155,7 @@ void generate_methods(TemplateDictionary *dict, Xml::Nodes &methods)
 				all_args_dict->SetValue("METHOD_ARG_IN_OUT", "true");
 			}
 			adaptor_arg_dict = sync_method_dict->AddSectionDictionary("METHOD_ADAPTOR_ARG_LIST");
-			adaptor_arg_dict->SetValue("METHOD_ARG_DECL", arg_decl);
+			adaptor_arg_dict->SetValue("METHOD_ARG_DECL", adaptor_arg_decl);
 			adaptor_arg_dict->SetValue("METHOD_ARG_NAME", arg_name);
 		}
 		arg_dict = async_method_dict->AddSectionDictionary("METHOD_ARG_LIST");
@@ -304,6 +353,32 @@ void generate_stubs(Xml::Document &doc, const char *filename,
 		}
 		generate_methods(if_dict, methods);
 
+		// members are found by a switch compiled into the stubs rather
+		// than in the method and signal tables
+		vector< pair<string, string> > method_members;
+		for (Xml::Nodes::iterator mi = methods.begin(); mi != methods.end(); ++mi)
+		{
+			string name = (*mi)->get("name");
+			method_members.push_back(make_pair(name, "return _" + legalize(name) + "_stub(__call);"));
+		}
+		if (!method_members.empty())
+		{
+			if_dict->SetValue("METHOD_SWITCH", member_switch(method_members, "__member", "        "));
+			if_dict->ShowSection("METHOD_SWITCH_SECTION");
+		}
+
+		vector< pair<string, string> > signal_members;
+		for (Xml::Nodes::iterator si = signals.begin(); si != signals.end(); ++si)
+		{
+			string name = (*si)->get("name");
+			signal_members.push_back(make_pair(name, "return _" + legalize(name) + "_stub(__sig);"));
+		}
+		if (!signal_members.empty())
+		{
+			if_dict->SetValue("SIGNAL_SWITCH", member_switch(signal_members, "__member", "        "));
+			if_dict->ShowSection("SIGNAL_SWITCH_SECTION");
+		}
+
 		// this loop generates all signals
 		for (Xml::Nodes::iterator si = signals.begin(); si != signals.end(); ++si)
 		{
@@ -23,6 +23,7 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <map>
 
 #include <dbus/dbus.h>		// for DBUS_TYPE_*
 
@@ -166,6 +167,34 @@ string signature_to_type(const string &signature)
 	return type;
 }
 
+/*	types for arguments which may point into the incoming message instead
+	of owning a copy; anything without a borrowed form keeps its usual type
+*/
+string signature_to_borrowed_type(const string &signature)
+{
+	if (signature == "s")
+		return "::DBus::StringRef";
+	if (signature == "o")
+		return "::DBus::PathRef";
+
+	if (signature.length() == 2 && signature[0] == DBUS_TYPE_ARRAY)
+	{
+		switch (signature[1])
+		{
+			case DBUS_TYPE_BYTE:
+			case DBUS_TYPE_INT16:
+			case DBUS_TYPE_UINT16:
+			case DBUS_TYPE_INT32:
+			case DBUS_TYPE_UINT32:
+			case DBUS_TYPE_INT64:
+			case DBUS_TYPE_UINT64:
+			case DBUS_TYPE_DOUBLE:
+				return string("::DBus::ArrayRef< ") + atomic_type_to_string(signature[1]) + " >";
+		}
+	}
+	return signature_to_type(signature);
+}
+
 bool is_primitive_type(const string &signature) {
 	unsigned int len = signature.length();
 
@@ -194,3 +223,90 @@ bool is_primitive_type(const string &signature) {
 			return false;
 	}
 }
+
+/*! Splits names of the same length on the byte which has the most
+ * different values among them, then the names sharing a value on another
+ * byte, and so on, until each one is left alone and is checked in full.
+ */
+static void member_split(const vector< pair<string, string> > &members, const vector<size_t> &same,
+                         size_t length, const string &var, const string &indent, ostringstream &out)
+{
+	size_t pos = length;
+	size_t most = 1;
+
+	for (size_t p = 0; same.size() > 1 && p < length; ++p)
+	{
+		string seen;
+
+		for (size_t k = 0; k < same.size(); ++k)
+		{
+			if (seen.find(members[same[k]].first[p]) == string::npos)
+				seen += members[same[k]].first[p];
+		}
+		if (seen.length() > most)
+		{
+			most = seen.length();
+			pos = p;
+		}
+	}
+
+	// a single name, or the same one more than once
+	if (pos == length)
+	{
+		for (size_t k = 0; k < same.size(); ++k)
+		{
+			const string &name = members[same[k]].first;
+
+			out << indent << "if (!memcmp(" << var << ", \"" << name << "\", " << length << "))" << endl;
+			out << indent << "    " << members[same[k]].second << endl;
+		}
+		return;
+	}
+
+	map< char, vector<size_t> > by_byte;
+
+	for (size_t k = 0; k < same.size(); ++k)
+		by_byte[members[same[k]].first[pos]].push_back(same[k]);
+
+	out << indent << "switch (" << var << "[" << pos << "])" << endl;
+	out << indent << "{" << endl;
+
+	for (map< char, vector<size_t> >::iterator bi = by_byte.begin(); bi != by_byte.end(); ++bi)
+	{
+		out << indent << "case '" << bi->first << "':" << endl;
+		member_split(members, bi->second, length, var, indent + "    ", out);
+		out << indent << "    break;" << endl;
+	}
+
+	out << indent << "}" << endl;
+}
+
+/*! Code finding a member name among the ones given, each with the
+ * statement run for it: a switch on the name's length, then on bytes
+ * telling apart the names of that length, so that a lookup makes one
+ * memcmp() at most and no allocation.
+ */
+string member_switch(const vector< pair<string, string> > &members,
+                     const string &var, const string &indent)
+{
+	map< size_t, vector<size_t> > by_length;
+
+	for (size_t i = 0; i < members.size(); ++i)
+		by_length[members[i].first.length()].push_back(i);
+
+	ostringstream out;
+
+	out << indent << "switch (strlen(" << var << "))" << endl;
+	out << indent << "{" << endl;
+
+	for (map< size_t, vector<size_t> >::iterator li = by_length.begin(); li != by_length.end(); ++li)
+	{
+		out << indent << "case " << li->first << ":" << endl;
+		member_split(members, li->second, li->first, var, indent + "    ", out);
+		out << indent << "    break;" << endl;
+	}
+
+	out << indent << "}";
+
+	return out.str();
+}
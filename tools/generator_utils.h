@@ -27,13 +27,18 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <utility>
+#include <vector>
 
 const char *atomic_type_to_string(char t);
 std::string stub_name(std::string name);
 std::string signature_to_type(const std::string &signature);
+std::string signature_to_borrowed_type(const std::string &signature);
 bool is_primitive_type(const std::string &signature);
 void _parse_signature(const std::string &signature, std::string &type, unsigned int &i);
 void underscorize(std::string &str);
 std::string legalize(const std::string &str);
+std::string member_switch(const std::vector< std::pair<std::string, std::string> > &members,
+                          const std::string &var, const std::string &indent);
 
 #endif//__DBUSXX_TOOLS_GENERATOR_UTILS_H
@@ -5,7 +5,8 @@
 #define __dbusxx__{{FILE_STRING}}__PROXY_MARSHALL_H
 
 #include <dbus-c++/dbus.h>
-#include <cassert>{{BI_NEWLINE}}
+#include <cassert>
+#include <cstring>{{BI_NEWLINE}}
 
 {{#FOR_EACH_INTERFACE}}
 {{#FOR_EACH_NAMESPACE}}
@@ -203,6 +204,16 @@ private:
 
 {{/ASYNC_SECTION}}
 
+{{#SIGNAL_SWITCH_SECTION}}
+    /* finds the handler of a signal without going through the signal table
+     */
+    void _dispatch_signal(const char *__member, const ::DBus::SignalMessage &__sig)
+    {
+{{SIGNAL_SWITCH}}
+        return ::DBus::InterfaceProxy::_dispatch_signal(__member, __sig);
+    }
+
+{{/SIGNAL_SWITCH_SECTION}}
     /* unmarshallers (to unpack the DBus message before
      * calling the actual signal handler)
      */